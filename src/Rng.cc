@@ -0,0 +1,61 @@
+/**
+ * This file is part of SIGPacker. SIGPacker is free software:
+ * you can redistribute it and/or modify it under the terms of
+ * the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License,
+ * or (at your option) any later version.
+ *
+ * SIGPacker is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with SIGPacker.
+ * If not, see <https://www.gnu.org/licenses/>. 
+ *
+ * Copyright 2024, 2025 5IGI0 / Ethan L. C. Lorenzetti
+**/
+
+#include "Rng.hh"
+
+static inline uint64_t splitmix64(uint64_t &x) {
+    uint64_t z = (x += 0x9E3779B97F4A7C15);
+
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EB;
+    return z ^ (z >> 31);
+}
+
+static inline uint64_t rotl(uint64_t x, int k) {
+    return (x << k) | (x >> (64 - k));
+}
+
+Rng::Rng(uint64_t seed, uint64_t stream) {
+    uint64_t sm = stream;
+
+    // hash the stream id first, so close ids give unrelated states
+    sm = seed ^ splitmix64(sm);
+    for (auto &s : this->state)
+        s = splitmix64(sm);
+}
+
+uint64_t Rng::operator()() {
+    uint64_t *s     = this->state;
+    uint64_t result = rotl(s[1] * 5, 7) * 9;
+    uint64_t t      = s[1] << 17;
+
+    s[2] ^= s[0];
+    s[3] ^= s[1];
+    s[1] ^= s[2];
+    s[0] ^= s[3];
+    s[2] ^= t;
+    s[3]  = rotl(s[3], 45);
+
+    return result;
+}
+
+uint64_t Rng::below(uint64_t bound) {
+    // the modulo bias is irrelevant for the small bounds used here
+    return (*this)() % bound;
+}
@@ -0,0 +1,54 @@
+/**
+ * This file is part of SIGPacker. SIGPacker is free software:
+ * you can redistribute it and/or modify it under the terms of
+ * the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License,
+ * or (at your option) any later version.
+ *
+ * SIGPacker is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with SIGPacker.
+ * If not, see <https://www.gnu.org/licenses/>. 
+ *
+ * Copyright 2024, 2025 5IGI0 / Ethan L. C. Lorenzetti
+**/
+
+#ifndef RNG_HH
+#define RNG_HH
+
+#include <cstddef>
+#include <cstdint>
+
+/*  every consumer of randomness gets its own stream, derived from the
+    run seed (--seed) and a stream id. the same seed gives the same output
+    whatever the order (or the thread) in which streams are used. */
+enum {
+    RNG_STREAM_POLYFORM     = 1, // + function rva
+    RNG_STREAM_DATA_OBFS    = 2,
+    RNG_STREAM_IMPORTS      = 3,
+    RNG_STREAM_VARIANT      = 4, // + variant index, gives the seed of the variant
+};
+
+#define RNG_STREAM(kind, idx) (((uint64_t)(kind) << 48) ^ (uint64_t)(idx))
+
+/* xoshiro256**, seeded with splitmix64 */
+class Rng {
+    public:
+    typedef uint64_t result_type;
+
+    Rng(uint64_t seed, uint64_t stream = 0);
+    uint64_t operator()();
+    uint64_t below(uint64_t bound); // [0, bound)
+
+    // usable with std::shuffle & co
+    static constexpr uint64_t min() {return 0;}
+    static constexpr uint64_t max() {return UINT64_MAX;}
+    private:
+    uint64_t state[4];
+};
+
+#endif
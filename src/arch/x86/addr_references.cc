@@ -26,47 +26,52 @@
 
 #include "../../third/zydis/Zydis.h"
 
+/*
+    only lengths and displacements/immediates are needed here, so everything is
+    taken from the raw fields of a minimal decode (no operand decoding).
+*/
+
 static inline
-void x86_list_references_64(std::vector<poly_instr_t> &instrs, std::vector<uint64_t> &refs) {
-    for (size_t i = 0; i < instrs.size(); i++) {
-        for (size_t j = 0; j < instrs[i].instruction.info.operand_count; j++) {
-            auto &op = instrs[i].instruction.operands[j];
-            if (op.type == ZYDIS_OPERAND_TYPE_MEMORY) {
-                if (x86_get_unsized_register(op.mem.base) == REG_RIP || x86_get_unsized_register(op.mem.index) == REG_RIP)
-                    refs.push_back(instrs[i].initial_vaddr + op.mem.disp.value + instrs[i].instruction.info.length);
-            }
-        }
-    }
+void x86_list_references_64(ZydisDecodedInstruction &instr, uint64_t vaddr, std::vector<uint64_t> &refs) {
+    // in 64-bit mode, mod=00 rm=101 without sib is always [rip+disp32]
+    if ((instr.attributes & ZYDIS_ATTRIB_HAS_MODRM) &&
+        instr.raw.modrm.mod == 0 && instr.raw.modrm.rm == 5 &&
+        instr.raw.disp.size)
+        refs.push_back(vaddr + instr.raw.disp.value + instr.length);
 }
 
 static inline
-void x86_list_references_32(std::vector<poly_instr_t> &instrs, std::vector<uint64_t> &refs) {
-    for (size_t i = 0; i < instrs.size(); i++) {
-        for (size_t j = 0; j < instrs[i].instruction.info.operand_count; j++) {
-            auto &op = instrs[i].instruction.operands[j];
-            if (op.type == ZYDIS_OPERAND_TYPE_MEMORY) {
-                if (op.mem.disp.has_displacement && op.mem.disp.value > 0) {
-                    refs.push_back(op.mem.disp.value);
-                }
-            } else if (op.type == ZYDIS_OPERAND_TYPE_POINTER) {
-               refs.push_back(op.ptr.offset); 
-            } else if (op.type == ZYDIS_OPERAND_TYPE_IMMEDIATE) {
-                if (op.imm.value.s > 0) refs.push_back(op.imm.value.u);
-            }
-        }
+void x86_list_references_32(ZydisDecodedInstruction &instr, std::vector<uint64_t> &refs) {
+    if (instr.raw.disp.size && instr.raw.disp.value > 0)
+        refs.push_back(instr.raw.disp.value);
+
+    for (size_t j = 0; j < 2; j++) {
+        if (instr.raw.imm[j].size == 0)
+            continue;
+        // far pointers (ptr16:32) keep the offset in imm[0] and the selector in imm[1]
+        if (j == 1 && instr.opcode_map == ZYDIS_OPCODE_MAP_DEFAULT && (instr.opcode == 0x9A || instr.opcode == 0xEA))
+            break;
+        if (instr.raw.imm[j].value.s > 0)
+            refs.push_back(instr.raw.imm[j].value.u);
     }
 }
 
 void x86_list_references(uint8_t *buff, size_t bufflen, int mode, uint64_t vaddr, std::vector<uint64_t> &refs) {
-    std::vector<poly_instr_t> instrs;
-    int instr_id;
+    ZydisDecodedInstruction instr;
 
     refs.clear();
-    x86_decode_instrs(buff, bufflen, mode, instrs, instr_id, vaddr);
+    while (bufflen) {
+        if (!x86_decode_minimal(buff, bufflen, mode, instr))
+            break;
+
+        if (mode == ZYDIS_MACHINE_MODE_LONG_64) {
+            x86_list_references_64(instr, vaddr, refs);
+        } else {
+            x86_list_references_32(instr, refs);
+        }
 
-    if (mode == ZYDIS_MACHINE_MODE_LONG_64) {
-        x86_list_references_64(instrs, refs);
-    } else {
-        x86_list_references_32(instrs, refs);
+        buff    += instr.length;
+        bufflen -= instr.length;
+        vaddr   += instr.length;
     }
-}
\ No newline at end of file
+}
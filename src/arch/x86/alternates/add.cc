@@ -20,20 +20,19 @@
 #include "alternates.hh"
 
 void x86_find_alternate_add(
-    std::vector<poly_instr_t> &instrs, 
-    size_t idx, size_t free_space,
+    x86_instr_it_t target,
+    x86_decoded_instr_t &instr,
+    size_t free_space,
     std::vector<x86_alt_proposal_t> &proposals,
     ZydisMachineMode machine_mode
 ) {
-    auto &instr = instrs[idx];
-
     ZydisEncoderRequest req;
 
     // add a,b -> lea a,[a+b]
     if (
-        instr.instruction.operands[0].type == ZYDIS_OPERAND_TYPE_REGISTER && (
-            instr.instruction.operands[1].type == ZYDIS_OPERAND_TYPE_REGISTER ||
-            instr.instruction.operands[1].type == ZYDIS_OPERAND_TYPE_IMMEDIATE
+        instr.operands[0].type == ZYDIS_OPERAND_TYPE_REGISTER && (
+            instr.operands[1].type == ZYDIS_OPERAND_TYPE_REGISTER ||
+            instr.operands[1].type == ZYDIS_OPERAND_TYPE_IMMEDIATE
         )
     ) {
         memset(&req, 0, sizeof(req));
@@ -41,49 +40,49 @@ void x86_find_alternate_add(
         req.mnemonic              = ZYDIS_MNEMONIC_LEA;
         req.operand_count         = 2;
         req.operands[0].type      = ZYDIS_OPERAND_TYPE_REGISTER;
-        req.operands[0].reg.value = instr.instruction.operands[0].reg.value;
+        req.operands[0].reg.value = instr.operands[0].reg.value;
 
         req.operands[1].type        = ZYDIS_OPERAND_TYPE_MEMORY;
-        req.operands[1].mem.base    = instr.instruction.operands[0].reg.value;
+        req.operands[1].mem.base    = instr.operands[0].reg.value;
         // i dont know why i have to set it to 8
         // but if i don't do it it doesn't work (so i guess i have to set to that value /shrug)
-        req.operands[1].mem.size  = ((ZyanU16)ZydisRegisterGetWidth(machine_mode, instr.instruction.operands[0].reg.value))/8;
+        req.operands[1].mem.size  = ((ZyanU16)ZydisRegisterGetWidth(machine_mode, instr.operands[0].reg.value))/8;
 
         assert(
-            instr.instruction.operands[1].type == ZYDIS_OPERAND_TYPE_REGISTER ||
-            instr.instruction.operands[1].type == ZYDIS_OPERAND_TYPE_IMMEDIATE);
+            instr.operands[1].type == ZYDIS_OPERAND_TYPE_REGISTER ||
+            instr.operands[1].type == ZYDIS_OPERAND_TYPE_IMMEDIATE);
 
-        if (instr.instruction.operands[1].type == ZYDIS_OPERAND_TYPE_REGISTER) {
-            req.operands[1].mem.index = instr.instruction.operands[1].reg.value;
+        if (instr.operands[1].type == ZYDIS_OPERAND_TYPE_REGISTER) {
+            req.operands[1].mem.index = instr.operands[1].reg.value;
             req.operands[1].mem.scale = 1;
         } else {
-            req.operands[1].mem.displacement = instr.instruction.operands[1].imm.value.s;
+            req.operands[1].mem.displacement = instr.operands[1].imm.value.s;
         }
         
-        x86_add_proposal(req, idx, 1, free_space, instrs, proposals);
+        x86_add_proposal(req, target, 1, free_space, proposals);
 
         if (req.operands[1].mem.index != ZYDIS_REGISTER_NONE) {
             ZydisRegister tmp = req.operands[1].mem.base;
             req.operands[1].mem.base = req.operands[1].mem.index;
             req.operands[1].mem.index = tmp;
 
-            x86_add_proposal(req, idx, 1, free_space, instrs, proposals);
+            x86_add_proposal(req, target, 1, free_space, proposals);
         }
     }
 
     // add a,b -> sub a,-b
-    if (instr.instruction.operands[0].type == ZYDIS_OPERAND_TYPE_REGISTER  &&
-        instr.instruction.operands[1].type == ZYDIS_OPERAND_TYPE_IMMEDIATE &&
-        instr.instruction.operands[1].imm.value.s > 0
+    if (instr.operands[0].type == ZYDIS_OPERAND_TYPE_REGISTER  &&
+        instr.operands[1].type == ZYDIS_OPERAND_TYPE_IMMEDIATE &&
+        instr.operands[1].imm.value.s > 0
     ) {
         memset(&req, 0, sizeof(req));
         req.machine_mode          = machine_mode;
         req.mnemonic              = ZYDIS_MNEMONIC_SUB;
         req.operand_count         = 2;
         req.operands[0].type      = ZYDIS_OPERAND_TYPE_REGISTER;
-        req.operands[0].reg.value = instr.instruction.operands[0].reg.value;
+        req.operands[0].reg.value = instr.operands[0].reg.value;
         req.operands[1].type      = ZYDIS_OPERAND_TYPE_IMMEDIATE;
-        req.operands[1].imm.s     = -instr.instruction.operands[1].imm.value.s;
-        x86_add_proposal(req, idx, 1, free_space, instrs, proposals);
+        req.operands[1].imm.s     = -instr.operands[1].imm.value.s;
+        x86_add_proposal(req, target, 1, free_space, proposals);
     }
 }
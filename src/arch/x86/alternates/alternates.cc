@@ -27,15 +27,14 @@
 #include "../polymorph.hh"
 
 static void x86_find_alternate_operands(
-    std::vector<poly_instr_t> &instrs, 
-    size_t idx, size_t free_space,
+    x86_instr_it_t target,
+    x86_decoded_instr_t &instr,
+    size_t free_space,
     std::vector<x86_alt_proposal_t> &proposals,
     ZydisMachineMode machine_mode
 ) {
-    auto &instr = instrs[idx];
-
-    for (size_t i = 0; i < instr.instruction.info.operand_count_visible; i++) {
-        auto &op = instr.instruction.operands[i];
+    for (size_t i = 0; i < instr.info.operand_count_visible; i++) {
+        auto &op = instr.operands[i];
 
         if (op.type == ZYDIS_OPERAND_TYPE_MEMORY) {
             if ( // invert mem operands
@@ -45,54 +44,107 @@ static void x86_find_alternate_operands(
                 op.mem.scale == 1) {
                 ZydisEncoderRequest req = {};
                 assert(ZYAN_SUCCESS(ZydisEncoderDecodedInstructionToEncoderRequest(
-                    &instr.instruction.info,
-                    instr.instruction.operands,
-                    instr.instruction.info.operand_count_visible,
+                    &instr.info,
+                    instr.operands,
+                    instr.info.operand_count_visible,
                     &req)));
                 
                 ZydisRegister tmp = req.operands[i].mem.base;
                 req.operands[i].mem.base = req.operands[i].mem.index;
                 req.operands[i].mem.index = tmp;
                 
-                x86_add_proposal(req, idx, 1, free_space, instrs, proposals);
+                x86_add_proposal(req, target, 1, free_space, proposals);
             }
         }
     }
 }
 
 void x86_find_alternate(
-    std::vector<poly_instr_t> &instrs,
-    size_t idx, size_t free_space,
+    x86_instr_it_t target,
+    size_t free_space,
     std::vector<x86_alt_proposal_t> &proposals,
     ZydisMachineMode machine_mode
 ) {
-    auto &instr = instrs[idx];
+    auto                &instr = *target;
+    x86_decoded_instr_t decoded;
+    bool                has_mem = false;
 
     // if it's conditional, we might break the condition
     // by changing it to another op that dont set the right flags.
     if (instr.is_conditional || instr.is_position_dependent || instr.is_generated || instr.use_ip)
         return;
 
-    x86_find_alternate_operands(instrs, idx, free_space, proposals, machine_mode);
+    for (size_t i = 0; i < instr.instruction.operand_count_visible; i++)
+        has_mem |= X86_OPERAND_TYPE(instr.instruction, i) == ZYDIS_OPERAND_TYPE_MEMORY;
+
+    // only pay for the full decode when something may match
+    switch (instr.instruction.mnemonic) {
+        case ZYDIS_MNEMONIC_ADD:
+        case ZYDIS_MNEMONIC_SUB:
+        case ZYDIS_MNEMONIC_MOV:
+        case ZYDIS_MNEMONIC_LEA:
+            break;
+        default:
+            if (!has_mem) return;
+    }
 
-    switch (instr.instruction.info.mnemonic) {
-        case ZYDIS_MNEMONIC_ADD: return x86_find_alternate_add(instrs, idx, free_space, proposals, machine_mode);
-        case ZYDIS_MNEMONIC_SUB: return x86_find_alternate_sub(instrs, idx, free_space, proposals, machine_mode);
-        case ZYDIS_MNEMONIC_MOV: return x86_find_alternate_mov(instrs, idx, free_space, proposals, machine_mode);
-        case ZYDIS_MNEMONIC_LEA: return x86_find_alternate_lea(instrs, idx, free_space, proposals, machine_mode);
+    bool ok = x86_decode_full(instr, decoded);
+    assert(ok);
+    (void)ok;
+    x86_find_alternate_operands(target, decoded, free_space, proposals, machine_mode);
+
+    switch (instr.instruction.mnemonic) {
+        case ZYDIS_MNEMONIC_ADD: return x86_find_alternate_add(target, decoded, free_space, proposals, machine_mode);
+        case ZYDIS_MNEMONIC_SUB: return x86_find_alternate_sub(target, decoded, free_space, proposals, machine_mode);
+        case ZYDIS_MNEMONIC_MOV: return x86_find_alternate_mov(target, decoded, free_space, proposals, machine_mode);
+        case ZYDIS_MNEMONIC_LEA: return x86_find_alternate_lea(target, decoded, free_space, proposals, machine_mode);
         default: return;
     }
 }
 
-void x86_find_alternates(std::vector<poly_instr_t> &instrs, std::vector<x86_alt_proposal_t> &proposals, ZydisMachineMode machine_mode) {
-    for (size_t i = 0; i < instrs.size(); i++) {
-        x86_find_alternate(instrs, i, x86_check_available_space(instrs, i), proposals, machine_mode);
+void x86_refresh_alternates(x86_instr_list_t &instrs, x86_space_index_t &space, x86_alt_cache_t &cache, int segment, ZydisMachineMode machine_mode) {
+    auto &proposals = cache[segment];
+    auto begin      = segment == 0 ? instrs.begin() : std::next(space[segment-1].last);
+    auto end        = space[segment].last == instrs.end() ? instrs.end() : std::next(space[segment].last);
+
+    for (auto &proposal : proposals)
+        free(proposal.alt_instrs);
+    proposals.clear();
+
+    // every instruction of the segment shares the same budget
+    for (auto it = begin; it != end; ++it)
+        x86_find_alternate(it, space[segment].free_space, proposals, machine_mode);
+}
+
+void x86_find_alternates(x86_instr_list_t &instrs, x86_space_index_t &space, x86_alt_cache_t &cache, ZydisMachineMode machine_mode) {
+    cache.resize(space.size());
+    for (size_t i = 0; i < space.size(); i++)
+        x86_refresh_alternates(instrs, space, cache, i, machine_mode);
+}
+
+size_t x86_count_alternates(x86_alt_cache_t &cache) {
+    size_t count = 0;
+
+    for (auto &proposals : cache)
+        count += proposals.size();
+    return count;
+}
+
+x86_alt_proposal_t &x86_get_alternate(x86_alt_cache_t &cache, size_t idx) {
+    for (auto &proposals : cache) {
+        if (idx < proposals.size())
+            return proposals[idx];
+        idx -= proposals.size();
     }
+    assert(false && "alternate index out of range");
+    return cache.front().front();
 }
 
-void x86_free_alternates(std::vector<x86_alt_proposal_t> &proposals) {
-    for (size_t i = 0; i < proposals.size(); i++) {
-        free(proposals[i].alt_instrs);
+void x86_free_alternates(x86_alt_cache_t &cache) {
+    for (auto &proposals : cache) {
+        for (size_t i = 0; i < proposals.size(); i++) {
+            free(proposals[i].alt_instrs);
+        }
     }
-    proposals.clear();
-}
\ No newline at end of file
+    cache.clear();
+}
@@ -31,34 +31,33 @@
 
 
 void x86_find_alternate_add(
-    std::vector<poly_instr_t> &instrs, size_t idx, size_t free_space,
+    x86_instr_it_t target, x86_decoded_instr_t &instr, size_t free_space,
     std::vector<x86_alt_proposal_t> &p, ZydisMachineMode mode);
 void x86_find_alternate_sub(
-    std::vector<poly_instr_t> &instrs, size_t idx, size_t free_space,
+    x86_instr_it_t target, x86_decoded_instr_t &instr, size_t free_space,
     std::vector<x86_alt_proposal_t> &p, ZydisMachineMode mode);
 void x86_find_alternate_mov(
-    std::vector<poly_instr_t> &instrs, size_t idx, size_t free_space,
+    x86_instr_it_t target, x86_decoded_instr_t &instr, size_t free_space,
     std::vector<x86_alt_proposal_t> &p, ZydisMachineMode mode);
 void x86_find_alternate_lea(
-    std::vector<poly_instr_t> &instrs, size_t idx, size_t free_space,
+    x86_instr_it_t target, x86_decoded_instr_t &instr, size_t free_space,
     std::vector<x86_alt_proposal_t> &p, ZydisMachineMode mode);
 
 static inline
 void x86_add_proposal(
     ZydisEncoderRequest &req,
-    size_t target_idx,
+    x86_instr_it_t target,
     size_t target_count,
     size_t free_space,
-    std::vector<poly_instr_t> &instrs,
     std::vector<x86_alt_proposal_t> &proposals
 ) {
     ZyanU8      buff[ZYDIS_MAX_INSTRUCTION_LENGTH];
     ZyanUSize   bufflen = ZYDIS_MAX_INSTRUCTION_LENGTH;
 
     assert(ZYAN_SUCCESS(ZydisEncoderEncodeInstruction(&req, buff, &bufflen)));
-    if (bufflen <= (instrs[target_idx].instruction.info.length + free_space)) { // TODO: sum if target_count > 1
+    if (bufflen <= (target->instruction.length + free_space)) { // TODO: sum if target_count > 1
         proposals.push_back(x86_alt_proposal_t{
-            .target_idx = target_idx,
+            .target = target,
             .target_count = target_count,
             .alt_instrs = memdup(buff, bufflen),
             .alt_instrs_size = bufflen});
@@ -69,10 +68,9 @@ static inline
 void x86_add_proposal_m(
     ZydisEncoderRequest *req,
     size_t req_count,
-    size_t target_idx,
+    x86_instr_it_t target,
     size_t target_count,
     size_t free_space,
-    std::vector<poly_instr_t> &instrs,
     std::vector<x86_alt_proposal_t> &proposals) {
     ZyanU8      buff[ZYDIS_MAX_INSTRUCTION_LENGTH * req_count];
     ZyanUSize   bufflen;
@@ -83,14 +81,14 @@ void x86_add_proposal_m(
 
         assert(ZYAN_SUCCESS(ZydisEncoderEncodeInstruction(req + i, buff + buff_offset, &bufflen)));
 
-        if ((buff_offset + bufflen) > (instrs[target_idx].instruction.info.length + free_space)) // TODO: sum if target_count > 1
+        if ((buff_offset + bufflen) > (target->instruction.length + free_space)) // TODO: sum if target_count > 1
             return;
 
         buff_offset += bufflen;
     }
 
     proposals.push_back(x86_alt_proposal_t{
-        .target_idx = target_idx,
+        .target = target,
         .target_count = target_count,
         .alt_instrs = memdup(buff, buff_offset),
         .alt_instrs_size = buff_offset});
@@ -20,24 +20,23 @@
 #include "alternates.hh"
 
 void x86_find_alternate_lea(
-    std::vector<poly_instr_t> &instrs, 
-    size_t idx, size_t free_space,
+    x86_instr_it_t target,
+    x86_decoded_instr_t &instr,
+    size_t free_space,
     std::vector<x86_alt_proposal_t> &proposals,
     ZydisMachineMode machine_mode
 ) {
-    auto &instr = instrs[idx];
-
     if (
-        instr.instruction.operands[0].type == ZYDIS_OPERAND_TYPE_REGISTER &&
-        instr.instruction.operands[1].type == ZYDIS_OPERAND_TYPE_MEMORY
+        instr.operands[0].type == ZYDIS_OPERAND_TYPE_REGISTER &&
+        instr.operands[1].type == ZYDIS_OPERAND_TYPE_MEMORY
     ) {
         ZydisEncoderRequest req[2];
         memset(req, 0, sizeof(req));
 
         assert(ZYAN_SUCCESS(ZydisEncoderDecodedInstructionToEncoderRequest(
-                    &instr.instruction.info,
-                    instr.instruction.operands,
-                    instr.instruction.info.operand_count_visible,
+                    &instr.info,
+                    instr.operands,
+                    instr.info.operand_count_visible,
                     &req[0])));
 
         if (req[0].operands[1].mem.displacement != 0) {
@@ -56,7 +55,7 @@ void x86_find_alternate_lea(
                 req[1].operands[1].imm.s = req[0].operands[1].mem.displacement;
                 
                 req[0].operands[1].mem.displacement = 0;
-                x86_add_proposal_m(req, 2, idx, 1, free_space, instrs, proposals);
+                x86_add_proposal_m(req, 2, target, 1, free_space, proposals);
                 req[0].operands[1].mem.displacement = req[1].operands[0].imm.s;
             } else { // TODO: is it possible?
                 req[1].machine_mode      = machine_mode;
@@ -66,7 +65,7 @@ void x86_find_alternate_lea(
                 req[1].operands[0].reg   = req[0].operands[0].reg;
                 req[1].operands[1].type  = ZYDIS_OPERAND_TYPE_IMMEDIATE;
                 req[1].operands[1].imm.s = req[0].operands[1].mem.displacement;
-                x86_add_proposal(req[1], idx, 1, free_space, instrs, proposals);
+                x86_add_proposal(req[1], target, 1, free_space, proposals);
             }
         }
     }
@@ -21,50 +21,49 @@
 #include <cstdint>
 
 void x86_find_alternate_mov(
-    std::vector<poly_instr_t> &instrs, 
-    size_t idx, size_t free_space,
+    x86_instr_it_t target,
+    x86_decoded_instr_t &instr,
+    size_t free_space,
     std::vector<x86_alt_proposal_t> &proposals,
     ZydisMachineMode machine_mode
 ) {
-    auto &instr = instrs[idx];
-
     ZydisEncoderRequest req;
 
     // mov a,b -> lea a,[b] (b = register)
     if (
-        instr.instruction.operands[0].type == ZYDIS_OPERAND_TYPE_REGISTER &&
-        instr.instruction.operands[1].type == ZYDIS_OPERAND_TYPE_REGISTER
+        instr.operands[0].type == ZYDIS_OPERAND_TYPE_REGISTER &&
+        instr.operands[1].type == ZYDIS_OPERAND_TYPE_REGISTER
     ) {
         memset(&req, 0, sizeof(req));
         req.machine_mode          = machine_mode;
         req.mnemonic              = ZYDIS_MNEMONIC_LEA;
         req.operand_count         = 2;
         req.operands[0].type      = ZYDIS_OPERAND_TYPE_REGISTER;
-        req.operands[0].reg.value = instr.instruction.operands[0].reg.value;
+        req.operands[0].reg.value = instr.operands[0].reg.value;
 
         req.operands[1].type        = ZYDIS_OPERAND_TYPE_MEMORY;
-        req.operands[1].mem.base    = instr.instruction.operands[1].reg.value;
-        req.operands[1].mem.size  = ((ZyanU16)ZydisRegisterGetWidth(machine_mode, instr.instruction.operands[0].reg.value))/8;
+        req.operands[1].mem.base    = instr.operands[1].reg.value;
+        req.operands[1].mem.size  = ((ZyanU16)ZydisRegisterGetWidth(machine_mode, instr.operands[0].reg.value))/8;
 
-        x86_add_proposal(req, idx, 1, free_space, instrs, proposals);
+        x86_add_proposal(req, target, 1, free_space, proposals);
     } else if (
         // mov a,b -> lea a,[b] (b = immediate)
-        instr.instruction.operands[0].type == ZYDIS_OPERAND_TYPE_REGISTER  &&
-        instr.instruction.operands[1].type == ZYDIS_OPERAND_TYPE_IMMEDIATE &&
-        instr.instruction.operands[1].imm.value.u <= INT32_MAX
+        instr.operands[0].type == ZYDIS_OPERAND_TYPE_REGISTER  &&
+        instr.operands[1].type == ZYDIS_OPERAND_TYPE_IMMEDIATE &&
+        instr.operands[1].imm.value.u <= INT32_MAX
     ) {
         memset(&req, 0, sizeof(req));
         req.machine_mode          = machine_mode;
         req.mnemonic              = ZYDIS_MNEMONIC_LEA;
         req.operand_count         = 2;
         req.operands[0].type      = ZYDIS_OPERAND_TYPE_REGISTER;
-        req.operands[0].reg.value = instr.instruction.operands[0].reg.value;
+        req.operands[0].reg.value = instr.operands[0].reg.value;
 
         req.operands[1].type             = ZYDIS_OPERAND_TYPE_MEMORY;
-        req.operands[1].mem.displacement = instr.instruction.operands[1].imm.value.s;
+        req.operands[1].mem.displacement = instr.operands[1].imm.value.s;
         // TODO: what the hell is this value supposed to be
-        req.operands[1].mem.size = 8;// ((ZyanU16)ZydisRegisterGetWidth(machine_mode, instr.instruction.operands[0].reg.value))/8;
+        req.operands[1].mem.size = 8;// ((ZyanU16)ZydisRegisterGetWidth(machine_mode, instr.operands[0].reg.value))/8;
 
-        x86_add_proposal(req, idx, 1, free_space, instrs, proposals);
+        x86_add_proposal(req, target, 1, free_space, proposals);
     }
 }
@@ -21,28 +21,27 @@
 #include <cstring>
 
 void x86_find_alternate_sub(
-    std::vector<poly_instr_t> &instrs, 
-    size_t idx, size_t free_space,
+    x86_instr_it_t target,
+    x86_decoded_instr_t &instr,
+    size_t free_space,
     std::vector<x86_alt_proposal_t> &proposals,
     ZydisMachineMode machine_mode
 ) {
-    auto &instr = instrs[idx];
-
     ZydisEncoderRequest req;
 
     // sub a,b -> add a,-b
-    if (instr.instruction.operands[0].type == ZYDIS_OPERAND_TYPE_REGISTER  &&
-        instr.instruction.operands[1].type == ZYDIS_OPERAND_TYPE_IMMEDIATE &&
-        instr.instruction.operands[1].imm.value.s > 0
+    if (instr.operands[0].type == ZYDIS_OPERAND_TYPE_REGISTER  &&
+        instr.operands[1].type == ZYDIS_OPERAND_TYPE_IMMEDIATE &&
+        instr.operands[1].imm.value.s > 0
     ) {
         memset(&req, 0, sizeof(req));
         req.machine_mode          = machine_mode;
         req.mnemonic              = ZYDIS_MNEMONIC_ADD;
         req.operand_count         = 2;
         req.operands[0].type      = ZYDIS_OPERAND_TYPE_REGISTER;
-        req.operands[0].reg.value = instr.instruction.operands[0].reg.value;
+        req.operands[0].reg.value = instr.operands[0].reg.value;
         req.operands[1].type      = ZYDIS_OPERAND_TYPE_IMMEDIATE;
-        req.operands[1].imm.s     = -instr.instruction.operands[1].imm.value.s;
-        x86_add_proposal(req, idx, 1, free_space, instrs, proposals);
+        req.operands[1].imm.s     = -instr.operands[1].imm.value.s;
+        x86_add_proposal(req, target, 1, free_space, proposals);
     }
 }
@@ -40,105 +40,51 @@ an instruction is not commutative if:
 */
 
 typedef struct {
-    char written_registers[REG_COUNT];
-    char read_registers[REG_COUNT];
+    uint32_t written_registers; // X86_REG_BIT masks, see x86_instr_t
+    uint32_t read_registers;
 } commutative_ctx_t;
 
-static void iter_regs(ZydisDisassembledInstruction &instr, void (*func)(ZydisRegister reg, ZydisOperandActions actions, void *data), void *data) {
-    for (size_t i = 0; i < instr.info.operand_count; i++) {
-        if (instr.operands[i].type == ZYDIS_OPERAND_TYPE_REGISTER)
-            func(instr.operands[i].reg.value, instr.operands[i].actions, data);
-        else if (instr.operands[i].type == ZYDIS_OPERAND_TYPE_MEMORY) {
-            /* if the memory operand use registers, then they are being read */
-            if (instr.operands[i].mem.base != ZYDIS_REGISTER_NONE)
-                func(instr.operands[i].mem.base, ZYDIS_OPERAND_ACTION_READ, data);
-            if (instr.operands[i].mem.index != ZYDIS_REGISTER_NONE)
-                func(instr.operands[i].mem.index, ZYDIS_OPERAND_ACTION_READ, data);
-        }
-    }
-}
-
-typedef struct {bool success; commutative_ctx_t *ctx;} check_action_data_t;
-static void check_actions_reg_iter(ZydisRegister reg, ZydisOperandActions actions, void *data) {
-    check_action_data_t *dt = (check_action_data_t *)data;
-
-    int unsized_reg = x86_get_unsized_register(reg);
-
-    if (unsized_reg == REG_NONE || unsized_reg == REG_FLAGS)
-        return;
-
-    if (unsized_reg < 0 || unsized_reg == REG_RIP) {
-        dt->success = false;
-        return;
-    }
-
-    if (
-        (actions & ZYDIS_OPERAND_ACTION_MASK_READ|ZYDIS_OPERAND_ACTION_MASK_WRITE) &&
-        dt->ctx->written_registers[unsized_reg])
-        dt->success = false;
-    if ((actions & ZYDIS_OPERAND_ACTION_MASK_WRITE) &&
-        (dt->ctx->written_registers[unsized_reg] || dt->ctx->read_registers[unsized_reg]))
-        dt->success = false;
-}
-
-static bool check_actions(ZydisDisassembledInstruction &instr, commutative_ctx_t *ctx) {
-    check_action_data_t dt = {0};
-    dt.success = true;
-    dt.ctx = ctx;
-
-    for (size_t i = 0; i < instr.info.operand_count; i++) {
-        if (
-            (instr.operands[i].type == ZYDIS_OPERAND_TYPE_MEMORY ||
-            instr.operands[i].type == ZYDIS_OPERAND_TYPE_POINTER) &&
-            (instr.operands[i].actions & ZYDIS_OPERAND_ACTION_MASK_WRITE))
-            return false;
-    }
+static bool check_actions(x86_instr_t &instr, commutative_ctx_t *ctx) {
+    // flags are handled by the conditional grouping
+    uint32_t accessed = (instr.regs_read | instr.regs_written) & ~X86_REG_BIT(REG_FLAGS);
+    uint32_t written  = instr.regs_written & ~X86_REG_BIT(REG_FLAGS);
 
-    iter_regs(instr, check_actions_reg_iter, &dt);
-    return dt.success;
+    return
+        !instr.writes_memory &&
+        !(accessed & (X86_REG_BIT_OTHER | X86_REG_BIT(REG_RIP))) &&
+        !(accessed & ctx->written_registers) &&
+        !(written  & ctx->read_registers);
 }
 
-static void update_registers_iter(ZydisRegister reg, ZydisOperandActions actions, void *data) {
-    commutative_ctx_t *ctx = (commutative_ctx_t *)data;
-
-    int unsized_reg = x86_get_unsized_register(reg);
-
-    if (unsized_reg <= REG_NONE)
-        return;
-
-    if (actions & ZYDIS_OPERAND_ACTION_MASK_READ)
-        ctx->read_registers[unsized_reg] = 1;
-    if (actions & ZYDIS_OPERAND_ACTION_MASK_WRITE)
-        ctx->written_registers[unsized_reg] = 1;
-}
-
-static bool is_commutative(ZydisDisassembledInstruction &instr, commutative_ctx_t *ctx) {
+static bool is_commutative(x86_instr_t &instr, commutative_ctx_t *ctx) {
     if (!check_actions(instr, ctx))
         return false;
-    
-    iter_regs(instr, update_registers_iter, ctx);
+
+    ctx->read_registers    |= instr.regs_read;
+    ctx->written_registers |= instr.regs_written;
     return true;
 }
 
-static void clean_alone_commutatives(std::vector<poly_instr_t> &instrs) {
-    for (size_t i = 0; i < instrs.size(); i++) {
-        if (instrs[i].is_commutative) {
+static void clean_alone_commutatives(x86_instr_list_t &instrs) {
+    for (auto it = instrs.begin(); it != instrs.end(); ++it) {
+        if (it->is_commutative) {
+            auto next = std::next(it);
             if (
-                (i == 0 || instrs[i-1].group_id != instrs[i].group_id) &&
-                ((i == instrs.size()-1) || instrs[i+1].group_id != instrs[i].group_id)) {
-                instrs[i].group_id = 0;
-                instrs[i].is_commutative = 0;
+                (it == instrs.begin() || std::prev(it)->group_id != it->group_id) &&
+                (next == instrs.end() || next->group_id != it->group_id)) {
+                it->group_id = 0;
+                it->is_commutative = 0;
             }
         }
     }
 }
 
-void x86_group_commutative_ops(std::vector<poly_instr_t> &instrs, int &group_id) {
+void x86_group_commutative_ops(x86_instr_list_t &instrs, int &group_id) {
     commutative_ctx_t ctx = {0};
 
     group_id++;
-    for (size_t i = 0; i < instrs.size(); i++) {
-        if (instrs[i].group_id) {
+    for (auto &instr : instrs) {
+        if (instr.group_id) {
             group_id++;
             memset(&ctx, 0, sizeof(ctx));
             continue;
@@ -146,22 +92,22 @@ void x86_group_commutative_ops(std::vector<poly_instr_t> &instrs, int &group_id)
 
         /*  if it is a jump destination,
             then it can't be inverted with previous instructions */
-        if (instrs[i].is_jmp_dst) {
+        if (instr.is_jmp_dst) {
             memset(&ctx, 0, sizeof(ctx));
             group_id++;
         }
 
-        if (is_commutative(instrs[i].instruction, &ctx)) {
-            instrs[i].group_id = group_id;
-            instrs[i].is_commutative = true;
+        if (is_commutative(instr.instruction, &ctx)) {
+            instr.group_id = group_id;
+            instr.is_commutative = true;
         } else {
             group_id++;
             memset(&ctx, 0, sizeof(ctx));
             /*  if is it not commutative, check if it is contextual
                 if it is, then add it to the next commutative group */
-            if (is_commutative(instrs[i].instruction, &ctx)) {
-                instrs[i].group_id = group_id;
-                instrs[i].is_commutative = true;
+            if (is_commutative(instr.instruction, &ctx)) {
+                instr.group_id = group_id;
+                instr.is_commutative = true;
             } else
                 memset(&ctx, 0, sizeof(ctx));
         }
@@ -24,6 +24,6 @@
 
 #include "polymorph.hh"
 
-void x86_group_commutative_ops(std::vector<poly_instr_t> &instrs, int &group_id);
+void x86_group_commutative_ops(x86_instr_list_t &instrs, int &group_id);
 
 #endif
\ No newline at end of file
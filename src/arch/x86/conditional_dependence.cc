@@ -22,48 +22,75 @@
 
 #include "polymorph.hh"
 
-static int find_modifier(std::vector<poly_instr_t> &instrs, size_t start_point, int flag_bit) {
-    for (ssize_t i = start_point; i >= 0; i--) {
-        if (instrs[i].instruction.info.cpu_flags) {
-            if (instrs[i].instruction.info.cpu_flags->modified & flag_bit)
-                return i;
-        }
-    }
-    return -1;
-}
+/*  there are 22 cpu flags in the zydis lib,
+    from what i see, there is no define for it. */
+#define X86_CPU_FLAG_COUNT 22
 
-void x86_group_conditional_ops(std::vector<poly_instr_t> &instrs, int &group_id) {
+void x86_group_conditional_ops(x86_instr_list_t &instrs, int &group_id) {
     /*  the principle is straightforward,
         1. find instructions that access CPU's flags
         2. seek for the last one that modified it
-        3. group them */
+        3. group them
+
+        it is done in a single forward pass, keeping the last writer of each flag.
+        an instruction is grouped to its farthest writer, and if this range overlaps
+        the previous group, both are merged instead of relabeling the whole range. */
+
+    std::vector<x86_instr_it_t> positions;
+    int last_writer[X86_CPU_FLAG_COUNT];
+    int open_start = -1;
+    int open_end   = -1;
+
+    for (int flag_id = 0; flag_id < X86_CPU_FLAG_COUNT; flag_id++)
+        last_writer[flag_id] = -1;
+
+    positions.reserve(instrs.size());
+    for (auto it = instrs.begin(); it != instrs.end(); ++it) {
+        int idx = positions.size();
+        positions.push_back(it);
 
-    for (size_t i = 0; i < instrs.size(); i++) {
-        if (instrs[i].instruction.info.cpu_flags) {
-            /*  there are 22 cpu flags in the zydis lib,
-                from what i see, there is no define for it. */
-            for (int flag_id = 0; flag_id < 22; flag_id++) {
-                int flag_bit = 1u << flag_id;
+        if (it->instruction.flags_tested) {
+            int start = idx;
 
-                if (instrs[i].instruction.info.cpu_flags->tested & flag_bit) {
+            // the instruction's own writes don't count (adc tests the carry of the previous one)
+            for (int flag_id = 0; flag_id < X86_CPU_FLAG_COUNT; flag_id++) {
+                if (!(it->instruction.flags_tested & (1u << flag_id)))
+                    continue;
 
-                    int ret = find_modifier(instrs, i, flag_bit);
+                if (last_writer[flag_id] < 0)
+                    std::cerr << "Warning: unable to find modifier for flag " << flag_id << std::endl;
+                else if (last_writer[flag_id] < start)
+                    start = last_writer[flag_id];
+            }
+
+            if (start != idx) {
+                int from = start;
 
-                    if (ret < 0) {
-                        std::cerr << "Warning: unable to find modifier for flag " << flag_id << std::endl;
-                    } else {
-                        group_id++;
-                        for (size_t j = ret; j < i+1; j++) {
-                            instrs[j].is_conditional = true;
-                            instrs[j].group_id = group_id;
-                        }
+                if (open_end >= start) {
+                    // overlaps the previous group, only label what is not in it yet
+                    for (int j = start; j < open_start; j++) {
+                        positions[j]->is_conditional = true;
+                        positions[j]->group_id = group_id;
                     }
-                    
-                    /*  TODO: i don't know if instruction op can test several flags at once
-                        if yes, then we should test every flags and group to the farest instruction */
-                    break;
+                    from = open_end + 1;
+                    if (start < open_start)
+                        open_start = start;
+                } else {
+                    group_id++;
+                    open_start = start;
+                }
+
+                for (int j = from; j <= idx; j++) {
+                    positions[j]->is_conditional = true;
+                    positions[j]->group_id = group_id;
                 }
+                open_end = idx;
             }
         }
+
+        for (int flag_id = 0; flag_id < X86_CPU_FLAG_COUNT; flag_id++) {
+            if (it->instruction.flags_modified & (1u << flag_id))
+                last_writer[flag_id] = idx;
+        }
     }
-}
\ No newline at end of file
+}
@@ -0,0 +1,93 @@
+/**
+ * This file is part of SIGPacker. SIGPacker is free software:
+ * you can redistribute it and/or modify it under the terms of
+ * the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License,
+ * or (at your option) any later version.
+ *
+ * SIGPacker is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with SIGPacker.
+ * If not, see <https://www.gnu.org/licenses/>. 
+ *
+ * Copyright 2024, 2025 5IGI0 / Ethan L. C. Lorenzetti
+**/
+
+#include <cassert>
+
+#include "polymorph.hh"
+
+/*
+    decoders and formatter are created once per mode and shared by every pass,
+    ZydisDecoderDecode* only read the decoder so it is fine to share them.
+*/
+
+static ZydisDecoder x86_make_decoder(int mode, bool minimal) {
+    ZydisDecoder decoder;
+    ZyanStatus   status;
+
+    status = ZydisDecoderInit(
+        &decoder, (ZydisMachineMode)mode,
+        mode == ZYDIS_MACHINE_MODE_LONG_64 ? ZYDIS_STACK_WIDTH_64 : ZYDIS_STACK_WIDTH_32);
+    assert(ZYAN_SUCCESS(status));
+    if (minimal) {
+        status = ZydisDecoderEnableMode(&decoder, ZYDIS_DECODER_MODE_MINIMAL, ZYAN_TRUE);
+        assert(ZYAN_SUCCESS(status));
+    }
+    (void)status;
+    return decoder;
+}
+
+ZydisDecoder const *x86_get_decoder(int mode, bool minimal) {
+    static ZydisDecoder const decoder_64      = x86_make_decoder(ZYDIS_MACHINE_MODE_LONG_64, false);
+    static ZydisDecoder const decoder_32      = x86_make_decoder(ZYDIS_MACHINE_MODE_LONG_COMPAT_32, false);
+    static ZydisDecoder const decoder_64_min  = x86_make_decoder(ZYDIS_MACHINE_MODE_LONG_64, true);
+    static ZydisDecoder const decoder_32_min  = x86_make_decoder(ZYDIS_MACHINE_MODE_LONG_COMPAT_32, true);
+
+    switch (mode) {
+        case ZYDIS_MACHINE_MODE_LONG_64:        return minimal ? &decoder_64_min : &decoder_64;
+        case ZYDIS_MACHINE_MODE_LEGACY_32:      // same decoding as compat mode
+        case ZYDIS_MACHINE_MODE_LONG_COMPAT_32: return minimal ? &decoder_32_min : &decoder_32;
+        default: assert(false && "unsupported machine mode");
+    }
+    return NULL;
+}
+
+bool x86_decode_buffer(uint8_t *buff, size_t bufflen, int mode, x86_decoded_instr_t &decoded) {
+    return ZYAN_SUCCESS(ZydisDecoderDecodeFull(x86_get_decoder(mode), buff, bufflen, &decoded.info, decoded.operands));
+}
+
+bool x86_decode_full(poly_instr_t const &instr, x86_decoded_instr_t &decoded) {
+    return x86_decode_buffer(instr.addr, instr.instruction.length, instr.instruction.machine_mode, decoded);
+}
+
+/* no operands and no semantic: length, mnemonic, attributes and the raw fields only */
+bool x86_decode_minimal(uint8_t *buff, size_t bufflen, int mode, ZydisDecodedInstruction &info) {
+    return ZYAN_SUCCESS(ZydisDecoderDecodeInstruction(x86_get_decoder(mode, true), NULL, buff, bufflen, &info));
+}
+
+static ZydisFormatter x86_make_formatter(void) {
+    ZydisFormatter formatter;
+
+    ZyanStatus status = ZydisFormatterInit(&formatter, ZYDIS_FORMATTER_STYLE_INTEL);
+    assert(ZYAN_SUCCESS(status));
+    (void)status;
+    return formatter;
+}
+
+/* only for debugging, nothing else should need the text */
+bool x86_format_instr(poly_instr_t const &instr, char *buff, size_t bufflen) {
+    static ZydisFormatter const formatter = x86_make_formatter();
+    x86_decoded_instr_t         decoded;
+
+    if (!x86_decode_full(instr, decoded))
+        return false;
+
+    return ZYAN_SUCCESS(ZydisFormatterFormatInstruction(
+        &formatter, &decoded.info, decoded.operands, decoded.info.operand_count_visible,
+        buff, bufflen, instr.instruction.runtime_address, NULL));
+}
@@ -0,0 +1,130 @@
+/**
+ * This file is part of SIGPacker. SIGPacker is free software:
+ * you can redistribute it and/or modify it under the terms of
+ * the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License,
+ * or (at your option) any later version.
+ *
+ * SIGPacker is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with SIGPacker.
+ * If not, see <https://www.gnu.org/licenses/>. 
+ *
+ * Copyright 2024, 2025 5IGI0 / Ethan L. C. Lorenzetti
+**/
+
+#include <cassert>
+#include <cstring>
+
+#include "emitter.hh"
+
+void x86_emitter_init(x86_emitter_t &em, ZydisMachineMode mode) {
+    em.mode = mode;
+    em.code.clear();
+    em.labels.clear();
+    em.fixups.clear();
+}
+
+// returns the offset of the instruction in the buffer
+size_t x86_emit(x86_emitter_t &em, ZydisEncoderRequest &req) {
+    ZyanU8      buff[ZYDIS_MAX_INSTRUCTION_LENGTH];
+    ZyanUSize   bufflen = ZYDIS_MAX_INSTRUCTION_LENGTH;
+
+    ZyanStatus status = ZydisEncoderEncodeInstruction(&req, buff, &bufflen);
+    assert(ZYAN_SUCCESS(status));
+    (void)status;
+    return x86_emit_raw(em, buff, bufflen);
+}
+
+size_t x86_emit_raw(x86_emitter_t &em, uint8_t const *data, size_t len) {
+    size_t at = em.code.size();
+    em.code.insert(em.code.end(), data, data + len);
+    return at;
+}
+
+int x86_new_label(x86_emitter_t &em) {
+    em.labels.push_back(-1);
+    return em.labels.size()-1;
+}
+
+void x86_bind_label(x86_emitter_t &em, int label) {
+    assert(em.labels[label] == -1);
+    em.labels[label] = em.code.size();
+}
+
+/*  encodes the branch at `at` (buffer relative addresses only matter through
+    their difference, so the base doesn't have to be known for that). */
+static size_t x86_encode_branch(ZydisEncoderRequest &req, uint64_t at, uint64_t target, uint8_t *buff) {
+    ZyanUSize bufflen = ZYDIS_MAX_INSTRUCTION_LENGTH;
+
+    req.operands[0].imm.u = target;
+    ZyanStatus status = ZydisEncoderEncodeInstructionAbsolute(&req, buff, &bufflen, at);
+    assert(ZYAN_SUCCESS(status));
+    (void)status;
+    return bufflen;
+}
+
+static size_t x86_emit_branch_fixup(x86_emitter_t &em, ZydisMnemonic mnemonic, int label, uint64_t target) {
+    ZyanU8      buff[ZYDIS_MAX_INSTRUCTION_LENGTH];
+    x86_fixup_t fixup;
+
+    memset(&fixup.req, 0, sizeof(fixup.req));
+    fixup.req.machine_mode     = em.mode;
+    fixup.req.mnemonic         = mnemonic;
+    fixup.req.operand_count    = 1;
+    fixup.req.operands[0].type = ZYDIS_OPERAND_TYPE_IMMEDIATE;
+    fixup.req.branch_type      = ZYDIS_BRANCH_TYPE_NEAR;
+    fixup.req.branch_width     = ZYDIS_BRANCH_WIDTH_32; // the size must not change once patched
+
+    fixup.at     = em.code.size();
+    fixup.label  = label;
+    fixup.target = target;
+    fixup.length = x86_encode_branch(fixup.req, fixup.at, fixup.at, buff); // placeholder
+    em.fixups.push_back(fixup);
+
+    return x86_emit_raw(em, buff, fixup.length);
+}
+
+// a bound label (backward branch) is encoded right away, in its shortest form
+size_t x86_emit_branch(x86_emitter_t &em, ZydisMnemonic mnemonic, int label) {
+    if (em.labels[label] == -1)
+        return x86_emit_branch_fixup(em, mnemonic, label, 0);
+
+    ZyanU8              buff[ZYDIS_MAX_INSTRUCTION_LENGTH];
+    ZydisEncoderRequest req;
+
+    memset(&req, 0, sizeof(req));
+    req.machine_mode     = em.mode;
+    req.mnemonic         = mnemonic;
+    req.operand_count    = 1;
+    req.operands[0].type = ZYDIS_OPERAND_TYPE_IMMEDIATE;
+
+    size_t len = x86_encode_branch(req, em.code.size(), em.labels[label], buff);
+    return x86_emit_raw(em, buff, len);
+}
+
+size_t x86_emit_branch_abs(x86_emitter_t &em, ZydisMnemonic mnemonic, uint64_t target) {
+    return x86_emit_branch_fixup(em, mnemonic, -1, target);
+}
+
+// the code will be placed at vaddr
+void x86_emitter_finish(x86_emitter_t &em, uint64_t vaddr) {
+    for (auto &fixup : em.fixups) {
+        ZyanU8   buff[ZYDIS_MAX_INSTRUCTION_LENGTH];
+        uint64_t target = fixup.target;
+
+        if (fixup.label != -1) {
+            assert(em.labels[fixup.label] != -1 && "branch to an unbound label");
+            target = vaddr + em.labels[fixup.label];
+        }
+
+        size_t len = x86_encode_branch(fixup.req, vaddr + fixup.at, target, buff);
+        assert(len == fixup.length);
+        memcpy(&em.code[fixup.at], buff, fixup.length);
+    }
+    em.fixups.clear();
+}
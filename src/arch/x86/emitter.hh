@@ -0,0 +1,58 @@
+/**
+ * This file is part of SIGPacker. SIGPacker is free software:
+ * you can redistribute it and/or modify it under the terms of
+ * the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License,
+ * or (at your option) any later version.
+ *
+ * SIGPacker is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with SIGPacker.
+ * If not, see <https://www.gnu.org/licenses/>. 
+ *
+ * Copyright 2024, 2025 5IGI0 / Ethan L. C. Lorenzetti
+**/
+
+#ifndef ARCH_X86_EMITTER_HH
+#define ARCH_X86_EMITTER_HH
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "../../third/zydis/Zydis.h"
+
+/*  small assembler for the generated stubs: instructions are encoded into a
+    local buffer, branches go to labels (or to absolute addresses out of the
+    buffer) and are resolved once the final address is known, then the whole
+    buffer is copied into the section in one go. */
+
+typedef struct {
+    size_t              at;     // offset of the branch in the buffer
+    uint8_t             length;
+    int                 label;  // -1 = absolute target
+    uint64_t            target;
+    ZydisEncoderRequest req;
+} x86_fixup_t;
+
+typedef struct {
+    ZydisMachineMode            mode;
+    std::vector<uint8_t>        code;
+    std::vector<int64_t>        labels; // offset in code, -1 = not bound yet
+    std::vector<x86_fixup_t>    fixups;
+} x86_emitter_t;
+
+void    x86_emitter_init(x86_emitter_t &em, ZydisMachineMode mode);
+size_t  x86_emit(x86_emitter_t &em, ZydisEncoderRequest &req);
+size_t  x86_emit_raw(x86_emitter_t &em, uint8_t const *data, size_t len);
+int     x86_new_label(x86_emitter_t &em);
+void    x86_bind_label(x86_emitter_t &em, int label);
+size_t  x86_emit_branch(x86_emitter_t &em, ZydisMnemonic mnemonic, int label);
+size_t  x86_emit_branch_abs(x86_emitter_t &em, ZydisMnemonic mnemonic, uint64_t target);
+void    x86_emitter_finish(x86_emitter_t &em, uint64_t vaddr);
+
+#endif
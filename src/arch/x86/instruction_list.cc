@@ -19,32 +19,90 @@
 
 #include <cassert>
 #include <stdio.h>
+#include <unordered_set>
 #include <vector>
 
 #include <cstring>
 
 #include "polymorph.hh"
+#include "registers.h"
 
-int x86_decode_instrs(uint8_t *buff, size_t bufflen, int mode, std::vector<poly_instr_t> &instrs, int &instr_id, uint64_t vaddr) {
-    poly_instr_t instruction = {0};
+static void x86_add_reg_access(x86_instr_t &instr, ZydisRegister reg, ZydisOperandActions actions) {
+    int      unsized_reg = x86_get_unsized_register(reg);
+    uint32_t bit         = unsized_reg < 0 ? X86_REG_BIT_OTHER : X86_REG_BIT(unsized_reg);
+
+    if (unsized_reg == REG_NONE)
+        return;
+
+    if (actions & ZYDIS_OPERAND_ACTION_MASK_READ)
+        instr.regs_read |= bit;
+    if (actions & ZYDIS_OPERAND_ACTION_MASK_WRITE)
+        instr.regs_written |= bit;
+}
+
+static void x86_summarize_instr(x86_decoded_instr_t &decoded, uint64_t vaddr, x86_instr_t &instr) {
+    bool has_imm = false;
+
+    memset(&instr, 0, sizeof(instr));
+    instr.runtime_address       = vaddr;
+    instr.mnemonic              = decoded.info.mnemonic;
+    instr.length                = decoded.info.length;
+    instr.operand_count_visible = decoded.info.operand_count_visible;
+    instr.machine_mode          = decoded.info.machine_mode;
+
+    if (decoded.info.cpu_flags) {
+        instr.flags_tested      = decoded.info.cpu_flags->tested;
+        instr.flags_modified    = decoded.info.cpu_flags->modified;
+    }
+
+    for (size_t i = 0; i < decoded.info.operand_count; i++) {
+        auto &op = decoded.operands[i];
+
+        if (i < decoded.info.operand_count_visible)
+            instr.operand_types |= op.type << (i*3);
+
+        switch (op.type) {
+            case ZYDIS_OPERAND_TYPE_REGISTER:
+                x86_add_reg_access(instr, op.reg.value, op.actions);
+                break;
+            case ZYDIS_OPERAND_TYPE_MEMORY:
+                /* if the memory operand use registers, then they are being read */
+                x86_add_reg_access(instr, op.mem.base, ZYDIS_OPERAND_ACTION_READ);
+                x86_add_reg_access(instr, op.mem.index, ZYDIS_OPERAND_ACTION_READ);
+                /* fallthrough */
+            case ZYDIS_OPERAND_TYPE_POINTER:
+                if (op.actions & ZYDIS_OPERAND_ACTION_MASK_WRITE)
+                    instr.writes_memory = true;
+                break;
+            case ZYDIS_OPERAND_TYPE_IMMEDIATE:
+                if (!has_imm && i < decoded.info.operand_count_visible) {
+                    instr.imm       = op.imm.value.s;
+                    instr.imm_size  = decoded.info.raw.imm[0].size;
+                    has_imm         = true;
+                }
+                break;
+            default: break;
+        }
+    }
+}
+
+int x86_decode_instrs(uint8_t *buff, size_t bufflen, int mode, x86_instr_list_t &instrs, int &instr_id, uint64_t vaddr) {
+    poly_instr_t        instruction = {0};
+    x86_decoded_instr_t decoded;
 
     while (bufflen) {
-        assert(ZYAN_SUCCESS(ZydisDisassembleIntel( // TODO: check error
-            /* machine_mode:    */ (ZydisMachineMode)mode,
-            /* runtime_address: */ vaddr,
-            /* buffer:          */ buff,
-            /* length:          */ bufflen,
-            /* instruction:     */ &instruction.instruction
-        )));
+        bool ok = x86_decode_buffer(buff, bufflen, mode, decoded); // TODO: check error
+        assert(ok);
+        (void)ok;
+        x86_summarize_instr(decoded, vaddr, instruction.instruction);
         instr_id++;
         instruction.addr            = buff;
         instruction.id              = instr_id;
         instruction.initial_vaddr   = vaddr;
         instrs.push_back(instruction);
-        buff    += instruction.instruction.info.length;
-        bufflen -= instruction.instruction.info.length;
-        vaddr   += instruction.instruction.info.length;
-        memset(&instruction, 0, sizeof(instruction.instruction));
+        buff    += instruction.instruction.length;
+        bufflen -= instruction.instruction.length;
+        vaddr   += instruction.instruction.length;
     }
 
     return 0;
@@ -53,114 +111,137 @@ int x86_decode_instrs(uint8_t *buff, size_t bufflen, int mode, std::vector<poly_
 /**
 TODO LIST:
 [ ] handle nops that are larger than 1 byte for instruction insertion
-  [ ] available_space
+  [ ] available_space
   [ ] insert instruction
-[ ] check jump size (after correction) in available_space
+[ ] check jump size (after correction) in available_space
 */
 
-#define IS_REMOVABLE_NOP(instr) (                              \
-    instr.instruction.info.mnemonic == ZYDIS_MNEMONIC_NOP  &&  \
-    instr.instruction.info.length   == 1                   &&  \
-    instr.is_position_dependent     == false               &&  \
-    instr.is_jmp_dst                == false)
-
-int x86_check_available_space(std::vector<poly_instr_t> &instrs, int offset) {
-    int available_space = 0;
-
-    // count nops before
-    for (int i = offset-1; i >= 0; i--) {
-        if (instrs[i].is_position_dependent)
-            break; // if it is position dependent, we can't remove a nop that is before it
+void x86_build_space_index(x86_instr_list_t &instrs, x86_space_index_t &space) {
+    int segment = 0;
 
-        if (IS_REMOVABLE_NOP(instrs[i]))
-            available_space += instrs[i].instruction.info.length;
+    // barriers+1 segments, the one after the last barrier may be empty
+    space.assign(1, {0, instrs.end()});
+    for (auto it = instrs.begin(); it != instrs.end(); ++it) {
+        it->segment = segment;
+        if (IS_REMOVABLE_NOP((*it)))
+            space[segment].free_space += it->instruction.length;
+        if (it->is_position_dependent) {
+            space[segment].last = it;
+            segment++;
+            space.push_back({0, instrs.end()});
+        }
     }
+}
 
-    for (int i = offset; i < instrs.size(); i++) {
-        if (instrs[i].is_position_dependent)
-            break; // if it is position dependent, we can't move it to bring nops
-
-        if (IS_REMOVABLE_NOP(instrs[i]))
-            available_space += instrs[i].instruction.info.length;
-    }
+// segment an instruction inserted before pos would belong to
+static int x86_segment_of(x86_instr_list_t &instrs, x86_instr_it_t pos) {
+    if (pos != instrs.end())
+        return pos->segment;
+    if (instrs.empty())
+        return 0;
+    return instrs.back().segment + instrs.back().is_position_dependent;
+}
 
-    return available_space;
+/*
+    nops that can be removed when inserting before pos: the ones after the
+    previous position dependent instruction and before the next one.
+*/
+int x86_check_available_space(x86_instr_list_t &instrs, x86_space_index_t &space, x86_instr_it_t pos) {
+    return space[x86_segment_of(instrs, pos)].free_space;
 }
 
+/* raw list edits that keep the space index up to date */
+x86_instr_it_t x86_list_insert(x86_instr_list_t &instrs, x86_space_index_t &space, x86_instr_it_t pos, poly_instr_t const &instr) {
+    int segment = x86_segment_of(instrs, pos);
 
-int x86_insert_instr(poly_instr_t instr, std::vector<poly_instr_t> &instrs, int idx) {
-    size_t needed_space = instr.instruction.info.length;
-    if (x86_check_available_space(instrs, idx) < instr.instruction.info.length)
-        return -1;
+    assert(!instr.is_position_dependent); // would split the segment
+    pos = instrs.insert(pos, instr);
+    pos->segment = segment;
+    if (IS_REMOVABLE_NOP(instr))
+        space[segment].free_space += instr.instruction.length;
+    return pos;
+}
 
-    for (int i = idx-1; i >= 0 && needed_space; i--) {
-        if (instrs[i].is_position_dependent)
+x86_instr_it_t x86_list_erase(x86_instr_list_t &instrs, x86_space_index_t &space, x86_instr_it_t pos) {
+    assert(!pos->is_position_dependent);
+    if (IS_REMOVABLE_NOP((*pos)))
+        space[pos->segment].free_space -= pos->instruction.length;
+    return instrs.erase(pos);
+}
+
+/* removes `needed_space` bytes of nops around pos, the caller has checked there are enough */
+x86_instr_it_t x86_remove_nops(x86_instr_list_t &instrs, x86_space_index_t &space, x86_instr_it_t pos, size_t needed_space) {
+    for (auto it = pos; it != instrs.begin() && needed_space;) {
+        --it;
+        if (it->is_position_dependent)
             break; // if it is position dependent, we can't remove a nop that is before it
 
-        if (IS_REMOVABLE_NOP(instrs[i])) {
-            auto it = instrs.begin();
-            std::advance(it, i);
-            instrs.erase(it);
-            needed_space -= instrs[i].instruction.info.length;
-            idx--;
-            i++;
+        if (IS_REMOVABLE_NOP((*it))) {
+            needed_space -= it->instruction.length;
+            it = x86_list_erase(instrs, space, it);
         }
     }
 
-    for (int i = idx; i < instrs.size() && needed_space; i++) {
-        if (instrs[i].is_position_dependent)
+    for (auto it = pos; it != instrs.end() && needed_space;) {
+        if (it->is_position_dependent)
             break; // if it is position dependent, we can't move it to bring nops
 
-        if (IS_REMOVABLE_NOP(instrs[i])) {
-            auto it = instrs.begin();
-            std::advance(it, i);
-            instrs.erase(it);
-            needed_space -= instrs[i].instruction.info.length;
-            i--;
-        }
+        if (IS_REMOVABLE_NOP((*it))) {
+            bool is_pos = it == pos;
+            needed_space -= it->instruction.length;
+            it = x86_list_erase(instrs, space, it);
+            if (is_pos)
+                pos = it;
+        } else
+            ++it;
     }
 
-    auto it = instrs.begin();
-    std::advance(it, idx);
-    instrs.insert(it, instr);
+    return pos;
+}
+
+x86_instr_it_t x86_insert_instr(poly_instr_t instr, x86_instr_list_t &instrs, x86_space_index_t &space, x86_instr_it_t pos) {
+    if (x86_check_available_space(instrs, space, pos) < instr.instruction.length)
+        return instrs.end();
 
-    return idx;
+    pos = x86_remove_nops(instrs, space, pos, instr.instruction.length);
+    return x86_list_insert(instrs, space, pos, instr);
 }
 
-void x86_update_addresses(std::vector<poly_instr_t> &instrs, uint64_t vaddr) {
-    for (size_t i = 0; i < instrs.size(); i++) {
-        instrs[i].instruction.runtime_address = vaddr;
-        vaddr += instrs[i].instruction.info.length;
+poly_instr_t x86_nop_instr(int machine_mode) {
+    poly_instr_t nop_instr = {
+        .addr = (uint8_t *)"\x90",
+        .instruction = {
+            .mnemonic = ZYDIS_MNEMONIC_NOP,
+            .length = 1,
+            .machine_mode = (uint8_t)machine_mode}};
+
+    return nop_instr;
+}
+
+void x86_update_addresses(x86_instr_list_t &instrs, uint64_t vaddr) {
+    for (auto &instr : instrs) {
+        instr.instruction.runtime_address = vaddr;
+        vaddr += instr.instruction.length;
     }
 }
 
-void x86_apply_alternate(std::vector<poly_instr_t> &instrs, x86_alt_proposal_t alt, ZydisMachineMode machine_mode) {
+void x86_apply_alternate(x86_instr_list_t &instrs, x86_space_index_t &space, x86_alt_proposal_t alt, ZydisMachineMode machine_mode) {
     // 1. replace all target instrs by nops
     // 2. add alternates
 
-    size_t       total_target_size = 0;
-    poly_instr_t backup_instr = instrs[alt.target_idx];
+    size_t          total_target_size = 0;
+    poly_instr_t    backup_instr = *alt.target;
+    x86_instr_it_t  target = alt.target;
     for (size_t i = 0; i < alt.target_count; i++) {
-        total_target_size += instrs[alt.target_idx].instruction.info.length;
-        auto it = instrs.begin();
-        std::advance(it, alt.target_idx);
-        instrs.erase(it); // TODO: free
+        total_target_size += target->instruction.length;
+        target = x86_list_erase(instrs, space, target); // TODO: free
     }
 
-    poly_instr_t nop_instr = {
-        .addr = (uint8_t *)"\x90",
-        .instruction = {
-            .info = {
-                .mnemonic = ZYDIS_MNEMONIC_NOP,
-                .length = 1},
-            .text = "nop"}};
-    for (size_t i = 0; i < total_target_size; i++) {
-        auto it = instrs.begin();
-        std::advance(it, alt.target_idx);
-        instrs.insert(it, nop_instr);
-    }
+    poly_instr_t nop_instr = x86_nop_instr(machine_mode);
+    for (size_t i = 0; i < total_target_size; i++)
+        target = x86_list_insert(instrs, space, target, nop_instr);
 
-    std::vector<poly_instr_t> alt_instrs;
+    x86_instr_list_t alt_instrs;
     int alt_id = 0;
 
     uint8_t *copbuf = (uint8_t *)malloc(alt.alt_instrs_size);
@@ -168,22 +249,52 @@ void x86_apply_alternate(std::vector<poly_instr_t> &instrs, x86_alt_proposal_t a
 
     x86_decode_instrs(copbuf, alt.alt_instrs_size, machine_mode, alt_instrs, alt_id);
 
-    size_t target_idx = alt.target_idx;
-    for (ssize_t i = alt_instrs.size() - 1; i >= 0; i--) {
-        if (i == 0) {
-            alt_instrs[0].id = backup_instr.id;
-            alt_instrs[0].is_alloc = true;
-        }
-        alt_instrs[0].is_generated = true;
-        target_idx = x86_insert_instr(alt_instrs[i], instrs, target_idx);
+    // the local ids would collide with the function ones, nothing can jump to them anyway
+    for (auto &instr : alt_instrs)
+        instr.id = 0;
+    alt_instrs.front().id       = backup_instr.id;
+    alt_instrs.front().is_alloc = true;
+    alt_instrs.front().is_generated = true;
+    for (auto it = alt_instrs.rbegin(); it != alt_instrs.rend(); ++it)
+        target = x86_insert_instr(*it, instrs, space, target);
+}
+
+/*  an alternate only edits its segment, saving the instructions of the
+    segment (not its barrier, which never moves) is enough to undo it. */
+static x86_instr_it_t x86_segment_begin(x86_instr_list_t &instrs, x86_space_index_t &space, int segment) {
+    return segment == 0 ? instrs.begin() : std::next(space[segment-1].last);
+}
+
+int x86_save_segment(x86_instr_list_t &instrs, x86_space_index_t &space, int segment, x86_instr_list_t &saved) {
+    saved.assign(x86_segment_begin(instrs, space, segment), space[segment].last);
+    return space[segment].free_space;
+}
+
+void x86_restore_segment(x86_instr_list_t &instrs, x86_space_index_t &space, int segment, x86_instr_list_t &saved, int free_space) {
+    std::unordered_set<uint8_t *> saved_buffers;
+    auto begin = x86_segment_begin(instrs, space, segment);
+    auto end   = space[segment].last;
+
+    for (auto &instr : saved) {
+        if (instr.is_alloc)
+            saved_buffers.insert(instr.addr);
     }
+    // only the buffers allocated since the save
+    for (auto it = begin; it != end; ++it) {
+        if (it->is_alloc && !saved_buffers.count(it->addr))
+            free(it->addr);
+    }
+
+    instrs.erase(begin, end);
+    instrs.splice(end, saved);
+    space[segment].free_space = free_space;
 }
 
-void x86_free_instr_list(std::vector<poly_instr_t> &instrs) {
-    for (size_t i = 0; i < instrs.size(); i++) {
-        if (instrs[i].is_alloc) {
-            free(instrs[i].addr);
+void x86_free_instr_list(x86_instr_list_t &instrs) {
+    for (auto &instr : instrs) {
+        if (instr.is_alloc) {
+            free(instr.addr);
         }
     }
     instrs.clear();
-}
\ No newline at end of file
+}
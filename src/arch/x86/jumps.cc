@@ -19,6 +19,7 @@
 
 #include <cassert>
 #include <iostream>
+#include <unordered_map>
 #include <vector>
 #include <cstdlib>
 #include <cstring>
@@ -60,96 +61,333 @@ static bool is_jump(int mnemonic) {
     }
 }
 
-void x86_find_jump_destinations(std::vector<poly_instr_t> &instrs) {
-    for (size_t i = 0; i < instrs.size(); i++) {
-        if (!is_jump(instrs[i].instruction.info.mnemonic))
+void x86_find_jump_destinations(x86_instr_list_t &instrs) {
+    /* address -> instruction, so each jump is resolved in O(1) */
+    std::unordered_map<uint64_t, poly_instr_t *> by_addr;
+
+    by_addr.reserve(instrs.size());
+    for (auto &instr : instrs)
+        by_addr.emplace(instr.instruction.runtime_address, &instr);
+
+    for (auto &instr : instrs) {
+        if (!is_jump(instr.instruction.mnemonic))
             continue;
 
-        if (instrs[i].instruction.info.operand_count_visible    != 1 ||
-            instrs[i].instruction.operands[0].type              != ZYDIS_OPERAND_TYPE_IMMEDIATE) {
+        if (instr.instruction.operand_count_visible         != 1 ||
+            X86_OPERAND_TYPE(instr.instruction, 0)          != ZYDIS_OPERAND_TYPE_IMMEDIATE) {
             // std::cerr << "Warning: unexpected combination jmp/addr" << std::endl;
-            instrs[i].is_position_dependent = true;
+            instr.is_position_dependent = true;
             continue;
         }
 
-        instrs[i].is_patchable_jump = true;
-        intptr_t target_addr = 
-            instrs[i].instruction.runtime_address +
-            instrs[i].instruction.operands[0].imm.value.s +
-            instrs[i].instruction.info.length;
+        instr.is_patchable_jump = true;
+        uint64_t target_addr =
+            instr.instruction.runtime_address +
+            instr.instruction.imm +
+            instr.instruction.length;
         
-        if (target_addr < instrs[0].instruction.runtime_address || target_addr > instrs[instrs.size()-1].instruction.runtime_address) {
+        if (target_addr < instrs.front().instruction.runtime_address || target_addr > instrs.back().instruction.runtime_address) {
             // std::cerr << "Warning: jump out of frame" << std::endl;
-            instrs[i].jump_info.instr_id    = 0;
+            instr.jump_info.instr_id    = 0;
+            instr.jump_info.offset      = (int32_t)(target_addr - instrs.front().instruction.runtime_address);
             continue;
         }
 
-        bool success = false;
-        for (size_t y = 0; y < instrs.size(); y++) {
-            if (instrs[y].instruction.runtime_address == target_addr) {
-                success = true;
-                instrs[y].is_jmp_dst = true;
-                instrs[i].jump_info.instr_id = instrs[y].id;
-                instrs[i].jump_info.offset   = 0;
-                break;
-            }
+        auto dst = by_addr.find(target_addr);
+        if (dst == by_addr.end()) {
+            std::cerr << "Warning: jump inside instruction" << std::endl;
+            exit(0);
         }
 
-        if (!success) {
-            std::cerr << "Warning: jump inside instruction" << std::endl;
+        dst->second->is_jmp_dst  = true;
+        instr.jump_info.instr_id = dst->second->id;
+        instr.jump_info.offset   = 0;
+    }
+}
+
+/* the displacement is the last immediate of the jump, 8, 16 (66 E9) or 32 bits wide */
+#define X86_JUMP_IS_SHORT(jmp) ((jmp).instruction.imm_size == 8)
+
+static void x86_build_offsets(x86_instr_list_t &instrs, std::unordered_map<int, uintptr_t> &offsets) {
+    uintptr_t offset = 0;
+
+    offsets.clear();
+    offsets.reserve(instrs.size());
+    for (auto &instr : instrs) {
+        if (instr.id) // id 0 is never a destination
+            offsets.emplace(instr.id, offset);
+        offset += instr.instruction.length;
+    }
+}
+
+// displacement from the end of the jump to its destination
+static intptr_t x86_jump_rel(x86_instr_list_t &instrs, std::unordered_map<int, uintptr_t> &offsets, poly_instr_t &jmp) {
+    intptr_t dst_offset = jmp.jump_info.offset;
+
+    if (jmp.jump_info.instr_id != 0) {
+        auto dst = offsets.find(jmp.jump_info.instr_id);
+        if (dst == offsets.end()) {
+            std::cerr << "unable to find jump destination (jump fixing)" << std::endl;
             exit(0);
         }
+        dst_offset += dst->second;
     }
+
+    return dst_offset - (jmp.instruction.runtime_address - instrs.front().instruction.runtime_address) - jmp.instruction.length;
 }
 
-int x86_fix_jumps(std::vector<poly_instr_t> &instrs) {
-    x86_update_addresses(instrs);
+/*
+    jmp rel8 (EB) -> jmp rel32 (E9), +3 bytes
+    jcc rel8 (7x) -> jcc rel32 (0F 8x), +4 bytes
+    the extra bytes are taken from the nops around the jump so the function keeps its size.
+*/
+static size_t x86_promote_grow(poly_instr_t const &jmp) {
+    uint8_t opcode = jmp.addr[jmp.instruction.length-2];
+
+    if (opcode == 0xEB)
+        return 3;
+    if ((opcode & 0xF0) == 0x70)
+        return 4;
+    return 0; // jcxz & co have no rel32 form
+}
+
+static int x86_promote_jump(x86_instr_list_t &instrs, x86_space_index_t &space, x86_instr_it_t jmp) {
+    size_t  length  = jmp->instruction.length;
+    uint8_t opcode  = jmp->addr[length-2];
+    size_t  grow    = x86_promote_grow(*jmp);
+
+    if (grow == 0 || x86_check_available_space(instrs, space, jmp) < (int)grow)
+        return -1;
+    x86_remove_nops(instrs, space, jmp, grow);
 
-    for (size_t i = 0; i < instrs.size(); i++) {
-        if (!instrs[i].is_patchable_jump)
+    uint8_t *instr_data = (uint8_t *)calloc(1, length + grow);
+    memcpy(instr_data, jmp->addr, length-2); // prefixes
+    if (opcode == 0xEB) {
+        instr_data[length-2] = 0xE9;
+    } else {
+        instr_data[length-2] = 0x0F;
+        instr_data[length-1] = 0x80 | (opcode & 0x0F);
+    }
+
+    if (jmp->is_alloc)
+        free(jmp->addr);
+    jmp->is_alloc               = true;
+    jmp->addr                   = instr_data;
+    jmp->instruction.length    += grow;
+    jmp->instruction.imm_size   = 32;
+    jmp->jump_info.is_relaxed   = true;
+    return 0;
+}
+
+// back to rel8, the jump is padded with nops so nothing else moves
+static void x86_demote_jump(x86_instr_list_t &instrs, x86_space_index_t &space, x86_instr_it_t jmp) {
+    size_t  length  = jmp->instruction.length;
+    size_t  shrink;
+
+    if (jmp->addr[length-5] == 0xE9) {
+        jmp->addr[length-5] = 0xEB;
+        shrink = 3;
+    } else {
+        jmp->addr[length-6] = 0x70 | (jmp->addr[length-5] & 0x0F);
+        shrink = 4;
+    }
+
+    jmp->instruction.length    -= shrink;
+    jmp->instruction.imm_size   = 8;
+    jmp->jump_info.is_relaxed   = false;
+
+    poly_instr_t nop_instr = x86_nop_instr(jmp->instruction.machine_mode);
+    for (size_t i = 0; i < shrink; i++)
+        x86_list_insert(instrs, space, std::next(jmp), nop_instr);
+}
+
+/*
+    relaxation: rel8 jumps that overflow are promoted to rel32.
+    it runs on a flat copy of the layout (lengths, nops, barriers), so the
+    polymorph loop can check each alternate without editing the list.
+    a promotion removes nops exactly like x86_promote_jump, the promoted
+    jumps are listed in order so they can be replayed on the list.
+*/
+typedef struct {
+    x86_instr_it_t  it;
+    int             dst;        // index of the destination, -1 when out of frame
+    int32_t         dst_offset; // added to the destination offset
+    uint8_t         length;     // 0 once a nop is removed
+    uint8_t         grow;       // promotion cost, 0 if it can't be promoted
+    bool            is_short_jump;
+    bool            is_nop;
+    bool            is_barrier;
+} x86_relax_item_t;
+
+static void x86_relax_build(x86_instr_list_t &instrs, std::vector<x86_relax_item_t> &items) {
+    std::unordered_map<int, int> by_id;
+
+    items.clear();
+    items.reserve(instrs.size());
+    by_id.reserve(instrs.size());
+    for (auto it = instrs.begin(); it != instrs.end(); ++it) {
+        x86_relax_item_t item = {it, -1, 0, it->instruction.length, 0, false, IS_REMOVABLE_NOP((*it)), it->is_position_dependent};
+
+        if (it->is_patchable_jump) {
+            item.dst_offset     = it->jump_info.offset;
+            item.is_short_jump  = X86_JUMP_IS_SHORT(*it);
+            item.grow           = item.is_short_jump ? x86_promote_grow(*it) : 0;
+        }
+        if (it->id) // id 0 is never a destination
+            by_id.emplace(it->id, items.size());
+        items.push_back(item);
+    }
+
+    for (auto &item : items) {
+        if (!item.it->is_patchable_jump || item.it->jump_info.instr_id == 0)
             continue;
+        auto dst = by_id.find(item.it->jump_info.instr_id);
+        if (dst == by_id.end()) {
+            std::cerr << "unable to find jump destination (jump fixing)" << std::endl;
+            exit(0);
+        }
+        item.dst = dst->second;
+    }
+}
 
-        intptr_t rel_addr = instrs[i].instruction.operands[0].imm.value.s;
+// same nops as x86_remove_nops: the closest ones before the jump, then after it
+static void x86_relax_remove_nops(std::vector<x86_relax_item_t> &items, size_t pos, size_t needed) {
+    for (size_t i = pos; i > 0 && needed;) {
+        --i;
+        if (items[i].is_barrier)
+            break;
+        if (items[i].is_nop && items[i].length) {
+            needed -= items[i].length;
+            items[i].length = 0;
+        }
+    }
 
-        if (instrs[i].jump_info.instr_id == 0) {
-            rel_addr -= (instrs[i].instruction.runtime_address - instrs[i].initial_vaddr) - instrs[i].instruction.info.length;
-        } else {
-            uintptr_t offset = 0;
-            bool success = false;
-            for (auto &instr : instrs) {
-                if (instr.id == instrs[i].jump_info.instr_id) {
-                    rel_addr = offset - (instrs[i].instruction.runtime_address - instrs[0].instruction.runtime_address);
-                    success = true;
-                }
-                offset += instr.instruction.info.length;
-            }
-            if (!success) {
-                std::cerr << "unable to find jump destination (jump fixing)" << std::endl;
-                exit(0);
-            }
+    for (size_t i = pos; i < items.size() && needed && !items[i].is_barrier; i++) {
+        if (items[i].is_nop && items[i].length) {
+            needed -= items[i].length;
+            items[i].length = 0;
         }
+    }
+}
+
+/*  jumps only grow, so it reaches a fixed point, each pass is linear.
+    (a pass works on offsets made stale by its own promotions,
+    the next one catches what was missed) */
+static int x86_relax(std::vector<x86_relax_item_t> &items, std::vector<int> &free_space, std::vector<size_t> *promoted) {
+    std::vector<intptr_t> offsets(items.size());
+    bool changed = true;
+
+    while (changed) {
+        intptr_t offset = 0;
+
+        changed = false;
+        for (size_t i = 0; i < items.size(); i++) {
+            offsets[i] = offset;
+            offset    += items[i].length;
+        }
+
+        for (size_t i = 0; i < items.size(); i++) {
+            x86_relax_item_t &jmp = items[i];
+            if (!jmp.is_short_jump)
+                continue;
+
+            intptr_t rel_addr = (jmp.dst >= 0 ? offsets[jmp.dst] : 0) + jmp.dst_offset - offsets[i] - jmp.length;
+            if (rel_addr >= -0x80 && rel_addr < 0x80)
+                continue;
+
+            int segment = jmp.it->segment;
+            if (jmp.grow == 0 || free_space[segment] < jmp.grow)
+                return -1;
+
+            x86_relax_remove_nops(items, i, jmp.grow);
+            free_space[segment] -= jmp.grow;
+            jmp.length          += jmp.grow;
+            jmp.is_short_jump    = false;
+            if (promoted)
+                promoted->push_back(i);
+            changed = true;
+        }
+    }
+
+    return 0;
+}
+
+// whether x86_fix_jumps would succeed, the nops it needs are counted against the space index
+bool x86_jumps_fit(x86_instr_list_t &instrs, x86_space_index_t &space) {
+    std::vector<x86_relax_item_t> items;
+    std::vector<int> free_space;
+
+    for (auto &segment : space)
+        free_space.push_back(segment.free_space);
+    x86_relax_build(instrs, items);
+    return x86_relax(items, free_space, NULL) == 0;
+}
+
+int x86_fix_jumps(x86_instr_list_t &instrs, x86_space_index_t &space) {
+    std::unordered_map<int, uintptr_t> offsets;
+    std::vector<x86_relax_item_t> items;
+    std::vector<int> free_space;
+    std::vector<size_t> promoted;
 
-        uint8_t *instr_data = (uint8_t *)malloc(instrs[i].instruction.info.length);
+    /* 1. relaxation, then the promotions are replayed on the list */
+    for (auto &segment : space)
+        free_space.push_back(segment.free_space);
+    x86_relax_build(instrs, items);
+    if (x86_relax(items, free_space, &promoted) < 0)
+        return -1;
+
+    for (auto i : promoted) {
+        int ret = x86_promote_jump(instrs, space, items[i].it);
+        assert(ret == 0 && "relaxation replay");
+        (void)ret;
+    }
+    x86_update_addresses(instrs);
+    x86_build_offsets(instrs, offsets);
+
+    /* 2. promoted jumps that fit again go back to rel8 (layout doesn't change) */
+    for (auto it = instrs.begin(); it != instrs.end(); ++it) {
+        if (!it->is_patchable_jump || !it->jump_info.is_relaxed)
+            continue;
 
-        if (instrs[i].instruction.info.length > 4) { // assuming it is 32bits operand
-            memcpy(instr_data, instrs[i].addr, instrs[i].instruction.info.length-4);
-            rel_addr -= instrs[i].instruction.info.length;
+        intptr_t rel_addr = x86_jump_rel(instrs, offsets, *it) + (it->addr[it->instruction.length-5] == 0xE9 ? 3 : 4);
+        if (rel_addr >= -0x80 && rel_addr < 0x80)
+            x86_demote_jump(instrs, space, it);
+    }
+    x86_update_addresses(instrs); // only the padding nops get a new address
+
+    /* 3. patch */
+    for (auto &jmp : instrs) {
+        if (!jmp.is_patchable_jump)
+            continue;
+
+        intptr_t rel_addr = x86_jump_rel(instrs, offsets, jmp);
+        uint8_t *instr_data = jmp.addr;
+
+        if (!jmp.is_alloc) {
+            instr_data = (uint8_t *)malloc(jmp.instruction.length);
+            memcpy(instr_data, jmp.addr, jmp.instruction.length);
+        }
+
+        if (jmp.instruction.imm_size == 32) {
             int32_t rel_addr32 = rel_addr;
             memcpy(
-                instr_data+instrs[i].instruction.info.length-4,
+                instr_data+jmp.instruction.length-4,
                 &rel_addr32, // assumes little-endian host
                 4);
-        } else { // assuming 8bits operand
-            memcpy(instr_data, instrs[i].addr, instrs[i].instruction.info.length-1);
-            rel_addr -= instrs[i].instruction.info.length;
-            assert(rel_addr < 0x80 && rel_addr >= -0x80); // is 8bits value + TODO:
+        } else if (jmp.instruction.imm_size == 16) {
+            assert(rel_addr < 0x8000 && rel_addr >= -0x8000); // rel16 jumps are never relaxed
+            int16_t rel_addr16 = rel_addr;
+            memcpy(instr_data+jmp.instruction.length-2, &rel_addr16, 2);
+        } else {
+            assert(jmp.instruction.imm_size == 8);
+            assert(rel_addr < 0x80 && rel_addr >= -0x80); // relaxation made sure it fits
             int8_t rel_addr8 = rel_addr;
-            instr_data[instrs[i].instruction.info.length-1] = rel_addr8;
+            instr_data[jmp.instruction.length-1] = rel_addr8;
         }
 
-        instrs[i].is_alloc  = true;
-        instrs[i].addr      = instr_data;
+        jmp.is_alloc  = true;
+        jmp.addr      = instr_data;
     }
 
     return 0;
-}
\ No newline at end of file
+}
@@ -24,7 +24,8 @@
 
 #include "polymorph.hh"
 
-void x86_find_jump_destinations(std::vector<poly_instr_t> &instrs);
-int x86_fix_jumps(std::vector<poly_instr_t> &instrs);
+void x86_find_jump_destinations(x86_instr_list_t &instrs);
+int x86_fix_jumps(x86_instr_list_t &instrs, x86_space_index_t &space);
+bool x86_jumps_fit(x86_instr_list_t &instrs, x86_space_index_t &space);
 
 #endif
\ No newline at end of file
@@ -22,7 +22,6 @@
 #include <cstdlib>
 #include <iomanip>
 #include <iostream>
-#include <random>
 #include <vector>
 
 #include <cstring>
@@ -41,12 +40,19 @@
 4. reassemble
 */
 
-static void x86_debug_print(std::vector<poly_instr_t> &instrs) {
-    int i = -1;
+// build with -DX86_POLYFORM_DEBUG to dump the analysed list
+#ifdef X86_POLYFORM_DEBUG
+static void x86_debug_print(x86_instr_list_t &instrs) {
+    x86_space_index_t space;
+
+    x86_build_space_index(instrs, space);
     std::cout << "ADDR    FREE FLAGS  GID  INSTR" << std::endl;
-    for (auto instr : instrs) {
+    for (auto it = instrs.begin(); it != instrs.end(); ++it) {
+        auto &instr = *it;
         char flags[] = "[    ]";
-        i++;
+        char disasm[96] = "(bad)";
+
+        x86_format_instr(instr, disasm, sizeof(disasm));
 
         flags[1] = instr.is_commutative         ? 'c' : ' ';
         flags[2] = instr.is_conditional         ? '?' : ' ';
@@ -55,13 +61,14 @@ static void x86_debug_print(std::vector<poly_instr_t> &instrs) {
 
         std::cout
             << std::hex << instr.instruction.runtime_address << std::dec << " [" <<
-            std::setw(3) << x86_check_available_space(instrs, i) << "]"
-            << flags << " " << std::setw(3) << instr.group_id << std::setw(0) << ": " << instr.instruction.text << std::endl;
+            std::setw(3) << x86_check_available_space(instrs, space, it) << "]"
+            << flags << " " << std::setw(3) << instr.group_id << std::setw(0) << ": " << disasm << std::endl;
     }
 }
+#endif
 
-int polyform_x86_r(uint8_t *buff, uint8_t *outbuff, size_t bufflen, int mode) {
-    std::vector<poly_instr_t> instrs;
+int polyform_x86_r(uint8_t *buff, uint8_t *outbuff, size_t bufflen, int mode, Rng &rng) {
+    x86_instr_list_t instrs;
     int group_id = 0;
     int instr_id = 0;
 
@@ -71,27 +78,36 @@ int polyform_x86_r(uint8_t *buff, uint8_t *outbuff, size_t bufflen, int mode) {
     x86_group_conditional_ops(instrs, group_id);
     x86_group_commutative_ops(instrs, group_id);
 
-    // x86_debug_print(instrs);
+#ifdef X86_POLYFORM_DEBUG
+    x86_debug_print(instrs);
+#endif
 
     /* shuffle commutatives */
-    for (auto it = instrs.begin(); it != instrs.end(); ++it) {
-        if (!it->is_commutative)
+    for (auto it = instrs.begin(); it != instrs.end();) {
+        if (!it->is_commutative) {
+            ++it;
             continue;
+        }
 
+        std::vector<x86_instr_it_t> group;
         auto end_it = it;
         int begin_instr_id = it->id;
 
         while (end_it != instrs.end() && end_it->group_id == it->group_id)
-            end_it++;
+            group.push_back(end_it++);
 
-        std::random_device rd;
-        std::mt19937 g(rd());
-        std::shuffle(it, end_it, g);
+        std::shuffle(group.begin(), group.end(), rng);
 
-        for (size_t j = 0; j < instrs.size(); j++) {
-            if (instrs[j].jump_info.instr_id == begin_instr_id)
-                instrs[j].jump_info.instr_id = it->id;
+        /* relink the group in its new order, nothing is copied */
+        for (auto &instr : group)
+            instrs.splice(end_it, instrs, instr);
+
+        for (auto &instr : instrs) {
+            if (instr.jump_info.instr_id == begin_instr_id)
+                instr.jump_info.instr_id = group.front()->id;
         }
+
+        it = end_it;
     }
 
     /* move nops (TODO: junk code) */
@@ -113,29 +129,47 @@ int polyform_x86_r(uint8_t *buff, uint8_t *outbuff, size_t bufflen, int mode) {
     //     }
     // }
 
-    std::vector<x86_alt_proposal_t> proposals;
-    for (size_t i = 1; i <= 20; i++) {
-        x86_free_alternates(proposals);
-        x86_find_alternates(instrs, proposals, (ZydisMachineMode)mode);
+    /* position dependence is final from here, so are the segments */
+    x86_space_index_t space;
+    x86_build_space_index(instrs, space);
+
+    x86_alt_cache_t alternates;
+    x86_find_alternates(instrs, space, alternates, (ZydisMachineMode)mode);
+    for (size_t i = 1;; i++) {
+        size_t count = x86_count_alternates(alternates);
 
         // TODO: find the right value to maximize possibilities & signature-proofness
-        if (proposals.size() / 2 < i)
+        if (count / 2 < i)
             break;
-        if (proposals.size() == 1 && rand() % 2)
+        if (count == 1 && rng.below(2))
             break;
 
-        x86_apply_alternate(instrs, proposals[rand() % proposals.size()], (ZydisMachineMode)mode);
+        x86_alt_proposal_t &alt = x86_get_alternate(alternates, rng.below(count));
+        int segment = alt.target->segment;
+        x86_instr_list_t saved;
+        int saved_space = x86_save_segment(instrs, space, segment, saved);
+
+        // an alternate that pushes jumps out of rel8 range with no nops left to promote them is undone
+        x86_apply_alternate(instrs, space, alt, (ZydisMachineMode)mode);
+        if (!x86_jumps_fit(instrs, space))
+            x86_restore_segment(instrs, space, segment, saved, saved_space);
+        x86_refresh_alternates(instrs, space, alternates, segment, (ZydisMachineMode)mode);
     }
 
-    x86_free_alternates(proposals);
-    x86_fix_jumps(instrs);
+    x86_free_alternates(alternates);
+    if (x86_fix_jumps(instrs, space) < 0) {
+        // only if the shuffled code didn't fit before any alternate, keep the original code
+        std::cerr << "Warning: unable to relax the jumps, function left unchanged" << std::endl;
+        x86_free_instr_list(instrs);
+        return -1;
+    }
     x86_fix_rips(instrs);
 
     size_t i = 0;
     memcpy(outbuff, buff, bufflen);
     for (auto &instr : instrs) {
-        memcpy(outbuff+i, instr.addr, instr.instruction.info.length);
-        i += instr.instruction.info.length;
+        memcpy(outbuff+i, instr.addr, instr.instruction.length);
+        i += instr.instruction.length;
     }
 
     x86_free_instr_list(instrs);
@@ -143,11 +177,11 @@ int polyform_x86_r(uint8_t *buff, uint8_t *outbuff, size_t bufflen, int mode) {
     return 0;
 }
 
-int polyform_x86(uint8_t *buff, size_t bufflen, int mode) {
+int polyform_x86(uint8_t *buff, size_t bufflen, int mode, Rng &rng) {
     uint8_t *outbuff = (uint8_t *)malloc(bufflen);
     assert(outbuff);
 
-    int ret = polyform_x86_r(buff, outbuff, bufflen, mode);
+    int ret = polyform_x86_r(buff, outbuff, bufflen, mode, rng);
     if (ret >= 0) {
         memcpy(buff, outbuff, bufflen);
     }
@@ -20,18 +20,48 @@
 #ifndef ARCH_X86_POLYMORPH_HH
 #define ARCH_X86_POLYMORPH_HH
 
+#include <list>
 #include <vector>
 
 #include <cstddef>
 #include <cstdint>
 
 #include "../../third/zydis/Zydis.h"
+#include "../../Rng.hh"
+
+/*  compact summary of a decoded instruction, it is everything the analysis passes need.
+    the full zydis operand detail is decoded again from the bytes when needed (x86_decode_full). */
+typedef struct {
+    uint64_t                runtime_address;
+    int64_t                 imm;            // first visible immediate operand
+    ZydisAccessedFlagsMask  flags_tested;
+    ZydisAccessedFlagsMask  flags_modified;
+    uint32_t                regs_read;      // X86_REG_BIT of unsized registers
+    uint32_t                regs_written;
+    uint16_t                mnemonic;
+    uint16_t                operand_types;  // 3 bits per visible operand, see X86_OPERAND_TYPE
+    uint8_t                 length;
+    uint8_t                 imm_size;       // encoded width of imm in bits, 0 if none
+    uint8_t                 operand_count_visible;
+    uint8_t                 machine_mode;
+    bool                    writes_memory;
+} x86_instr_t;
+
+#define X86_REG_BIT(reg)            (1u << (reg))
+#define X86_REG_BIT_OTHER           (1u << 31) // any register that has no unsized equivalent
+#define X86_OPERAND_TYPE(instr, i)  (((instr).operand_types >> ((i)*3)) & 7)
+
+typedef struct {
+    ZydisDecodedInstruction info;
+    ZydisDecodedOperand     operands[ZYDIS_MAX_OPERAND_COUNT];
+} x86_decoded_instr_t;
 
 typedef struct {
     uint8_t     *addr;
     uint64_t     initial_vaddr;
     int         id;
     int         group_id;
+    int         segment; // see x86_space_index_t
     bool        is_generated;
     bool        is_alloc;
     bool        is_commutative;
@@ -43,31 +73,73 @@ typedef struct {
     struct {
         int     instr_id; // 0 = out of frame (offset is computed from the begin)
         int32_t offset;
+        bool    is_relaxed; // rel8 promoted to rel32 by x86_fix_jumps
     } jump_info;
 
-    ZydisDisassembledInstruction instruction;
+    x86_instr_t instruction;
 } poly_instr_t;
 
+/*  the instruction list is edited a lot (nop removal, alternates insertion),
+    a linked list keeps these edits O(1) and its iterators stay valid. */
+typedef std::list<poly_instr_t>     x86_instr_list_t;
+typedef x86_instr_list_t::iterator  x86_instr_it_t;
+
+/*  free space index: the list is cut in segments by the position dependent
+    instructions (a barrier is the last instruction of its segment), each
+    segment knows how many bytes of removable nops it holds. */
 typedef struct {
-    size_t  target_idx;
+    int             free_space;
+    x86_instr_it_t  last; // the barrier, end() for the last segment
+} x86_space_segment_t;
+
+typedef std::vector<x86_space_segment_t> x86_space_index_t;
+
+// the free space of a segment is made of these
+#define IS_REMOVABLE_NOP(instr) (                              \
+    instr.instruction.mnemonic      == ZYDIS_MNEMONIC_NOP  &&  \
+    instr.instruction.length        == 1                   &&  \
+    instr.is_position_dependent     == false               &&  \
+    instr.is_jmp_dst                == false)
+
+typedef struct {
+    x86_instr_it_t  target;
     size_t  target_count;
     uint8_t *alt_instrs;
     size_t  alt_instrs_size;
 } x86_alt_proposal_t;
 
+/*  proposals per segment: an alternate only edits its target's segment,
+    so only this one has to be searched again. */
+typedef std::vector<std::vector<x86_alt_proposal_t>> x86_alt_cache_t;
+
 #define X86_DEFAULT_INSTR_LIST_VADDR (1 << 30)
 
-int     polyform_x86(uint8_t *buff, size_t bufflen, int mode);
-int     polyform_x86_r(uint8_t *buff, uint8_t *outbuff, size_t bufflen, int mode);
-int     x86_decode_instrs(uint8_t *buff, size_t bufflen, int mode, std::vector<poly_instr_t> &instrs, int &instr_id, uint64_t vaddr=X86_DEFAULT_INSTR_LIST_VADDR);
-int     x86_check_available_space(std::vector<poly_instr_t> &instrs, int offset);
-int     x86_insert_instr(poly_instr_t instr, std::vector<poly_instr_t> &instrs, int idx);
-void    x86_update_addresses(std::vector<poly_instr_t> &instrs, uint64_t vaddr=X86_DEFAULT_INSTR_LIST_VADDR);
-void    x86_find_rips(std::vector<poly_instr_t> &instrs);
-void    x86_fix_rips(std::vector<poly_instr_t> &instrs);
-void    x86_find_alternates(std::vector<poly_instr_t> &instrs, std::vector<x86_alt_proposal_t> &proposals, ZydisMachineMode machine_mode);
-void    x86_free_alternates(std::vector<x86_alt_proposal_t> &proposals);
-void    x86_apply_alternate(std::vector<poly_instr_t> &instrs, x86_alt_proposal_t alt, ZydisMachineMode machine_mode);
-void    x86_free_instr_list(std::vector<poly_instr_t> &instrs);
+int             polyform_x86(uint8_t *buff, size_t bufflen, int mode, Rng &rng);
+int             polyform_x86_r(uint8_t *buff, uint8_t *outbuff, size_t bufflen, int mode, Rng &rng);
+int             x86_decode_instrs(uint8_t *buff, size_t bufflen, int mode, x86_instr_list_t &instrs, int &instr_id, uint64_t vaddr=X86_DEFAULT_INSTR_LIST_VADDR);
+bool            x86_decode_buffer(uint8_t *buff, size_t bufflen, int mode, x86_decoded_instr_t &decoded);
+bool            x86_decode_full(poly_instr_t const &instr, x86_decoded_instr_t &decoded);
+bool            x86_decode_minimal(uint8_t *buff, size_t bufflen, int mode, ZydisDecodedInstruction &info);
+bool            x86_format_instr(poly_instr_t const &instr, char *buff, size_t bufflen);
+ZydisDecoder const *x86_get_decoder(int mode, bool minimal=false);
+void            x86_build_space_index(x86_instr_list_t &instrs, x86_space_index_t &space);
+int             x86_check_available_space(x86_instr_list_t &instrs, x86_space_index_t &space, x86_instr_it_t pos);
+x86_instr_it_t  x86_list_insert(x86_instr_list_t &instrs, x86_space_index_t &space, x86_instr_it_t pos, poly_instr_t const &instr);
+x86_instr_it_t  x86_list_erase(x86_instr_list_t &instrs, x86_space_index_t &space, x86_instr_it_t pos);
+x86_instr_it_t  x86_insert_instr(poly_instr_t instr, x86_instr_list_t &instrs, x86_space_index_t &space, x86_instr_it_t pos);
+x86_instr_it_t  x86_remove_nops(x86_instr_list_t &instrs, x86_space_index_t &space, x86_instr_it_t pos, size_t needed_space);
+poly_instr_t    x86_nop_instr(int machine_mode);
+void            x86_update_addresses(x86_instr_list_t &instrs, uint64_t vaddr=X86_DEFAULT_INSTR_LIST_VADDR);
+void            x86_find_rips(x86_instr_list_t &instrs);
+void            x86_fix_rips(x86_instr_list_t &instrs);
+void            x86_find_alternates(x86_instr_list_t &instrs, x86_space_index_t &space, x86_alt_cache_t &cache, ZydisMachineMode machine_mode);
+void            x86_refresh_alternates(x86_instr_list_t &instrs, x86_space_index_t &space, x86_alt_cache_t &cache, int segment, ZydisMachineMode machine_mode);
+size_t          x86_count_alternates(x86_alt_cache_t &cache);
+x86_alt_proposal_t &x86_get_alternate(x86_alt_cache_t &cache, size_t idx);
+void            x86_free_alternates(x86_alt_cache_t &cache);
+void            x86_apply_alternate(x86_instr_list_t &instrs, x86_space_index_t &space, x86_alt_proposal_t alt, ZydisMachineMode machine_mode);
+int             x86_save_segment(x86_instr_list_t &instrs, x86_space_index_t &space, int segment, x86_instr_list_t &saved);
+void            x86_restore_segment(x86_instr_list_t &instrs, x86_space_index_t &space, int segment, x86_instr_list_t &saved, int free_space);
+void            x86_free_instr_list(x86_instr_list_t &instrs);
 
 #endif
\ No newline at end of file
@@ -0,0 +1,132 @@
+/**
+ * This file is part of SIGPacker. SIGPacker is free software:
+ * you can redistribute it and/or modify it under the terms of
+ * the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License,
+ * or (at your option) any later version.
+ *
+ * SIGPacker is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with SIGPacker.
+ * If not, see <https://www.gnu.org/licenses/>. 
+ *
+ * Copyright 2024, 2025 5IGI0 / Ethan L. C. Lorenzetti
+**/
+
+#include <cstdint>
+
+#include "../../third/zydis/Zydis.h"
+
+#include "registers.h"
+
+/*
+    every lookup is a load in tables generated at compile time.
+    sized registers are indexed by log2 of their size in bytes (1, 2, 4, 8).
+*/
+
+typedef struct {
+    int             reg;
+    ZydisRegister   sized[4];
+} x86_register_def_t;
+
+static constexpr x86_register_def_t x86_register_defs[] = {
+    {REG_RAX,   {ZYDIS_REGISTER_AL,   ZYDIS_REGISTER_AX,   ZYDIS_REGISTER_EAX,   ZYDIS_REGISTER_RAX}},
+    {REG_RBX,   {ZYDIS_REGISTER_BL,   ZYDIS_REGISTER_BX,   ZYDIS_REGISTER_EBX,   ZYDIS_REGISTER_RBX}},
+    {REG_RCX,   {ZYDIS_REGISTER_CL,   ZYDIS_REGISTER_CX,   ZYDIS_REGISTER_ECX,   ZYDIS_REGISTER_RCX}},
+    {REG_RDX,   {ZYDIS_REGISTER_DL,   ZYDIS_REGISTER_DX,   ZYDIS_REGISTER_EDX,   ZYDIS_REGISTER_RDX}},
+    {REG_RSI,   {ZYDIS_REGISTER_SIL,  ZYDIS_REGISTER_SI,   ZYDIS_REGISTER_ESI,   ZYDIS_REGISTER_RSI}},
+    {REG_RDI,   {ZYDIS_REGISTER_DIL,  ZYDIS_REGISTER_DI,   ZYDIS_REGISTER_EDI,   ZYDIS_REGISTER_RDI}},
+    {REG_RBP,   {ZYDIS_REGISTER_BPL,  ZYDIS_REGISTER_BP,   ZYDIS_REGISTER_EBP,   ZYDIS_REGISTER_RBP}},
+    {REG_RSP,   {ZYDIS_REGISTER_SPL,  ZYDIS_REGISTER_SP,   ZYDIS_REGISTER_ESP,   ZYDIS_REGISTER_RSP}},
+    {REG_R8,    {ZYDIS_REGISTER_R8B,  ZYDIS_REGISTER_R8W,  ZYDIS_REGISTER_R8D,   ZYDIS_REGISTER_R8}},
+    {REG_R9,    {ZYDIS_REGISTER_R9B,  ZYDIS_REGISTER_R9W,  ZYDIS_REGISTER_R9D,   ZYDIS_REGISTER_R9}},
+    {REG_R10,   {ZYDIS_REGISTER_R10B, ZYDIS_REGISTER_R10W, ZYDIS_REGISTER_R10D,  ZYDIS_REGISTER_R10}},
+    {REG_R11,   {ZYDIS_REGISTER_R11B, ZYDIS_REGISTER_R11W, ZYDIS_REGISTER_R11D,  ZYDIS_REGISTER_R11}},
+    {REG_R12,   {ZYDIS_REGISTER_R12B, ZYDIS_REGISTER_R12W, ZYDIS_REGISTER_R12D,  ZYDIS_REGISTER_R12}},
+    {REG_R13,   {ZYDIS_REGISTER_R13B, ZYDIS_REGISTER_R13W, ZYDIS_REGISTER_R13D,  ZYDIS_REGISTER_R13}},
+    {REG_R14,   {ZYDIS_REGISTER_R14B, ZYDIS_REGISTER_R14W, ZYDIS_REGISTER_R14D,  ZYDIS_REGISTER_R14}},
+    {REG_R15,   {ZYDIS_REGISTER_R15B, ZYDIS_REGISTER_R15W, ZYDIS_REGISTER_R15D,  ZYDIS_REGISTER_R15}},
+    {REG_RIP,   {ZYDIS_REGISTER_NONE, ZYDIS_REGISTER_IP,   ZYDIS_REGISTER_EIP,   ZYDIS_REGISTER_RIP}},
+};
+
+// they are not part of the by-size conversion
+static constexpr x86_register_def_t x86_register_unsized_only[] = {
+    {REG_RAX,   {ZYDIS_REGISTER_AH}},
+    {REG_RBX,   {ZYDIS_REGISTER_BH}},
+    {REG_RCX,   {ZYDIS_REGISTER_CH}},
+    {REG_RDX,   {ZYDIS_REGISTER_DH}},
+    {REG_FLAGS, {ZYDIS_REGISTER_NONE, ZYDIS_REGISTER_FLAGS, ZYDIS_REGISTER_EFLAGS, ZYDIS_REGISTER_RFLAGS}},
+};
+
+typedef struct {
+    int8_t  unsized[ZYDIS_REGISTER_MAX_VALUE + 1];
+    int16_t sized[REG_COUNT][4];
+} x86_register_tables_t;
+
+static constexpr x86_register_tables_t x86_make_register_tables() {
+    x86_register_tables_t tables = {};
+
+    for (auto &unsized : tables.unsized)
+        unsized = -1;
+    for (auto &sized : tables.sized)
+        for (auto &reg : sized)
+            reg = -1;
+    tables.unsized[ZYDIS_REGISTER_NONE] = REG_NONE;
+
+    for (auto &def : x86_register_defs) {
+        for (int i = 0; i < 4; i++) {
+            if (def.sized[i] == ZYDIS_REGISTER_NONE)
+                continue;
+            tables.unsized[def.sized[i]] = def.reg;
+            tables.sized[def.reg][i]     = def.sized[i];
+        }
+    }
+
+    for (auto &def : x86_register_unsized_only) {
+        for (auto reg : def.sized) {
+            if (reg != ZYDIS_REGISTER_NONE)
+                tables.unsized[reg] = def.reg;
+        }
+    }
+
+    return tables;
+}
+
+static constexpr x86_register_tables_t x86_register_tables = x86_make_register_tables();
+
+static_assert(x86_register_tables.unsized[ZYDIS_REGISTER_AH]   == REG_RAX,  "high bytes are unsized");
+static_assert(x86_register_tables.unsized[ZYDIS_REGISTER_R8D]  == REG_R8,   "r8d is r8");
+static_assert(x86_register_tables.unsized[ZYDIS_REGISTER_XMM0] == -1,       "no unsized vector registers");
+static_assert(x86_register_tables.sized[REG_R15][2] == ZYDIS_REGISTER_R15D, "32 bits r15");
+static_assert(x86_register_tables.sized[REG_FLAGS][3] == -1,                "flags are not convertible");
+
+int x86_get_unsized_register(int reg) {
+    if (reg < 0 || reg > ZYDIS_REGISTER_MAX_VALUE)
+        return -1;
+    return x86_register_tables.unsized[reg];
+}
+
+int x86_get_64_register(int reg) {
+    return x86_get_register_by_size(reg, 8);
+}
+
+int x86_get_32_register(int reg) {
+    return x86_get_register_by_size(reg, 4);
+}
+
+int x86_get_register_by_size(int reg, int size) {
+    if (reg < 0 || reg >= REG_COUNT)
+        return -1;
+
+    switch (size) {
+        case 1: return x86_register_tables.sized[reg][0];
+        case 2: return x86_register_tables.sized[reg][1];
+        case 4: return x86_register_tables.sized[reg][2];
+        case 8: return x86_register_tables.sized[reg][3];
+        default: return -1;
+    }
+}
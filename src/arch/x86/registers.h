@@ -33,15 +33,10 @@ enum x86registers {
     REG_R14, REG_R15,
     REG_COUNT};
 
-#ifdef __cplusplus
-extern "C" {
-#endif
 // convert sized registers (ZYDIS_REGISTER_AL) to unsized register (REG_RAX)
 int x86_get_unsized_register(int reg);
+// and back, -1 if there is no such register (size is in bytes: 1, 2, 4 or 8)
 int x86_get_64_register(int reg);
 int x86_get_32_register(int reg);
 int x86_get_register_by_size(int reg, int size);
-#ifdef __cplusplus
-}
-#endif
 #endif
\ No newline at end of file
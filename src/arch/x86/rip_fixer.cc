@@ -17,28 +17,37 @@
  * Copyright 2024, 2025 5IGI0 / Ethan L. C. Lorenzetti
 **/
 
+#include <cassert>
 #include <cstring>
 
 #include "registers.h"
 #include "polymorph.hh"
 
-void x86_find_rips(std::vector<poly_instr_t> &instrs) {
-    for (size_t i = 0; i < instrs.size(); i++) {
-        for (size_t op_idx = 0; op_idx < instrs[i].instruction.info.operand_count_visible; op_idx++) {
-            switch (instrs[i].instruction.operands[op_idx].type) {
+void x86_find_rips(x86_instr_list_t &instrs) {
+    for (auto &instr : instrs) {
+        x86_decoded_instr_t decoded;
+
+        if (!((instr.instruction.regs_read | instr.instruction.regs_written) & X86_REG_BIT(REG_RIP)))
+            continue;
+
+        bool ok = x86_decode_full(instr, decoded);
+        assert(ok);
+        (void)ok;
+        for (size_t op_idx = 0; op_idx < decoded.info.operand_count_visible; op_idx++) {
+            switch (decoded.operands[op_idx].type) {
                 case ZYDIS_OPERAND_TYPE_MEMORY:
-                    if (x86_get_unsized_register(instrs[i].instruction.operands[op_idx].mem.base) == REG_RIP) {
-                        instrs[i].is_position_dependent = instrs[i].instruction.operands[op_idx].mem.disp.has_displacement == false;
-                        instrs[i].use_ip = true;
-                    } else if (x86_get_unsized_register(instrs[i].instruction.operands[op_idx].mem.index) == REG_RIP) {
-                        instrs[i].is_position_dependent = true; // TODO: patch rip when used as index
-                        instrs[i].use_ip = true;
+                    if (x86_get_unsized_register(decoded.operands[op_idx].mem.base) == REG_RIP) {
+                        instr.is_position_dependent = decoded.operands[op_idx].mem.disp.has_displacement == false;
+                        instr.use_ip = true;
+                    } else if (x86_get_unsized_register(decoded.operands[op_idx].mem.index) == REG_RIP) {
+                        instr.is_position_dependent = true; // TODO: patch rip when used as index
+                        instr.use_ip = true;
                     }
                     break;
                 case ZYDIS_OPERAND_TYPE_REGISTER:
-                    if (x86_get_unsized_register(instrs[i].instruction.operands[op_idx].reg.value) == REG_RIP) {
-                        instrs[i].is_position_dependent = true;
-                        instrs[i].use_ip = true;
+                    if (x86_get_unsized_register(decoded.operands[op_idx].reg.value) == REG_RIP) {
+                        instr.is_position_dependent = true;
+                        instr.use_ip = true;
                     }
                     break;
                 default: break;
@@ -47,27 +56,38 @@ void x86_find_rips(std::vector<poly_instr_t> &instrs) {
     }
 }
 
-void x86_fix_rips(std::vector<poly_instr_t> &instrs) {
-    for (size_t i = 0; i < instrs.size(); i++) {
-        if (instrs[i].is_position_dependent) continue;
-        for (size_t op_idx = 0; op_idx < instrs[i].instruction.info.operand_count_visible; op_idx++) {
+void x86_fix_rips(x86_instr_list_t &instrs) {
+    for (auto &instr : instrs) {
+        x86_decoded_instr_t decoded;
+
+        if (instr.is_position_dependent || !instr.use_ip) continue;
+
+        bool ok = x86_decode_full(instr, decoded);
+        assert(ok);
+        (void)ok;
+        for (size_t op_idx = 0; op_idx < decoded.info.operand_count_visible; op_idx++) {
             if (
-                instrs[i].instruction.operands[op_idx].type == ZYDIS_OPERAND_TYPE_MEMORY && // TODO register
-                instrs[i].instruction.operands[op_idx].mem.base == ZYDIS_REGISTER_RIP &&
-                instrs[i].instruction.operands[op_idx].mem.disp.has_displacement) {
+                decoded.operands[op_idx].type == ZYDIS_OPERAND_TYPE_MEMORY && // TODO register
+                decoded.operands[op_idx].mem.base == ZYDIS_REGISTER_RIP &&
+                decoded.operands[op_idx].mem.disp.has_displacement) {
                 ZydisEncoderRequest req;
-                assert(ZYAN_SUCCESS(ZydisEncoderDecodedInstructionToEncoderRequest(&instrs[i].instruction.info, instrs[i].instruction.operands, instrs[i].instruction.info.operand_count_visible, &req)));
-                req.operands[op_idx].mem.displacement -= (instrs[i].instruction.runtime_address - instrs[i].initial_vaddr);
+                ZyanStatus          status;
+
+                status = ZydisEncoderDecodedInstructionToEncoderRequest(&decoded.info, decoded.operands, decoded.info.operand_count_visible, &req);
+                assert(ZYAN_SUCCESS(status));
+                req.operands[op_idx].mem.displacement -= (instr.instruction.runtime_address - instr.initial_vaddr);
 
                 ZyanU8 encoded_instruction[ZYDIS_MAX_INSTRUCTION_LENGTH];
                 ZyanUSize encoded_length = sizeof(encoded_instruction);
 
-                assert(ZYAN_SUCCESS(ZydisEncoderEncodeInstruction(&req, encoded_instruction, &encoded_length)));
-                assert(instrs[i].instruction.info.length == encoded_length); // TODO: handle it properly
+                status = ZydisEncoderEncodeInstruction(&req, encoded_instruction, &encoded_length);
+                assert(ZYAN_SUCCESS(status));
+                assert(instr.instruction.length == encoded_length); // TODO: handle it properly
+                (void)status;
 
-                instrs[i].is_alloc  = true;
-                instrs[i].addr      = (uint8_t *)malloc(encoded_length);
-                memcpy(instrs[i].addr, encoded_instruction, encoded_length);
+                instr.is_alloc  = true;
+                instr.addr      = (uint8_t *)malloc(encoded_length);
+                memcpy(instr.addr, encoded_instruction, encoded_length);
                 break;
             }
         }
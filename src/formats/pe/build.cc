@@ -27,6 +27,10 @@
 #include <cstring>
 #include <ctime>
 
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
 unsigned char dos_stub[] = {
 0x4d, 0x5a, 0x90, 0x00, 0x03, 0x00, 0x00, 0x00, 0x04, 0x00, 0x00, 0x00, 0xff, 0xff, 0x00, 0x00,  // |MZ..............|
 0xb8, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x40, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,  // |........@.......|
@@ -99,11 +103,13 @@ static void prepare_section_table(
 
         if (infile_sections_tbl[i].SizeOfRawData) {
             infile_sections_tbl[i].PointerToRawData = after;
+            // appended sections are sized to their content, round them here
+            infile_sections_tbl[i].SizeOfRawData    = USE_ROUNDER(original_sec->SizeOfRawData, rounder);
         } else {
             infile_sections_tbl[i].PointerToRawData = 0;
         }
 
-        after += original_sec->SizeOfRawData;
+        after += infile_sections_tbl[i].SizeOfRawData;
     }
 }
 
@@ -127,9 +133,40 @@ void pe_update_and_put_headers(IMAGE_NT_HEADERS &original_hdr, uint8_t *dst, siz
     memcpy(dst, &hdr, sizeof(hdr));
 }
 
+static bool pe_write_at(int fd, uint8_t const *data, size_t len, off_t offset) {
+    while (len) {
+        ssize_t ret = pwrite(fd, data, len, offset);
+        if (ret < 0)
+            return false;
+        data   += ret;
+        len    -= ret;
+        offset += ret;
+    }
+    return true;
+}
+
+// same permissions as open(path, O_CREAT, 0666) would give
+static int pe_open_temp(char *tmp_path) {
+    int    fd   = mkstemp(tmp_path);
+    mode_t mask = umask(0);
+
+    umask(mask);
+    if (fd >= 0 && fchmod(fd, 0666 & ~mask) < 0) {
+        close(fd);
+        unlink(tmp_path);
+        return -1;
+    }
+    return fd;
+}
+
+/*  the output is written piece by piece (headers, then each section straight
+    from section_data), the padding between them is left as holes.
+    the checksum is summed from the (cached) section sums and patched at the end.
+    section_data may point in a mapping of an existing file, so nothing is
+    truncated in place: a temporary file next to the output is renamed over it. */
 void pe_build(pe_file_t &pe, runtime_t &runtime) {
-    uint8_t *pe_buff       = NULL;
     size_t  pe_size        = 0;
+    size_t  hdr_size       = 0;
     size_t  sec_tbl_offset = 0;
     size_t  rounder        = 0xFFF;
 
@@ -138,51 +175,71 @@ void pe_build(pe_file_t &pe, runtime_t &runtime) {
     size_t sec_count = drop_unwanted_sections(pe, io_section_map);
 
     /* 2. compute headers' size */
-    pe_size       += sizeof(dos_stub);
-    pe_size       += pe.is_PE32 ? sizeof(IMAGE_NT_HEADERS32) : sizeof(IMAGE_NT_HEADERS64);
-    sec_tbl_offset = pe_size;
-    pe_size       += sizeof(IMAGE_SECTION_HEADER) * sec_count;
+    hdr_size      += sizeof(dos_stub);
+    hdr_size      += pe.is_PE32 ? sizeof(IMAGE_NT_HEADERS32) : sizeof(IMAGE_NT_HEADERS64);
+    sec_tbl_offset = hdr_size;
+    hdr_size      += sizeof(IMAGE_SECTION_HEADER) * sec_count;
 
     /* 3. find offsets for sections (prepare section table) */
     rounder = PE_HDR(pe, FileAlignment)-1;
     IMAGE_SECTION_HEADER infile_sections_tbl[sec_count];
     memset(infile_sections_tbl, 0, sizeof(infile_sections_tbl));
-    prepare_section_table(pe, infile_sections_tbl, io_section_map, pe_size, rounder, sec_count);
+    prepare_section_table(pe, infile_sections_tbl, io_section_map, hdr_size, rounder, sec_count);
 
-    /* 4. compute final PE size & alloc */
+    /* 4. compute final PE size */
     pe_size = (infile_sections_tbl[sec_count-1].PointerToRawData +
                infile_sections_tbl[sec_count-1].SizeOfRawData);
     // position and size are aligned on x (and x > 4 theoretically),
     // so the final size is supposed to be a multiple of 4
     // which might cause issue for checksum computation if not true)
     assert((pe_size%4) == 0);
-    assert((pe_buff = (uint8_t *)calloc(1, pe_size)));
 
-    /* 5. put DOS stub */
-    memcpy(pe_buff, dos_stub, sizeof(dos_stub));
+    /* 5. put DOS stub, PE header (checksum = 0) and section table */
+    uint8_t hdr_buff[hdr_size];
+    uint32_t *checksum_ptr;
+    memcpy(hdr_buff, dos_stub, sizeof(dos_stub));
+    if (pe.is_PE32) {
+        pe_update_and_put_headers(*pe.nt_hdr.b32, hdr_buff+sizeof(dos_stub), sec_count);
+        checksum_ptr = &((PIMAGE_NT_HEADERS32)(hdr_buff+sizeof(dos_stub)))->OptionalHeader.CheckSum;
+    } else {
+        pe_update_and_put_headers(*pe.nt_hdr.b64, hdr_buff+sizeof(dos_stub), sec_count);
+        checksum_ptr = &((PIMAGE_NT_HEADERS64)(hdr_buff+sizeof(dos_stub)))->OptionalHeader.CheckSum;
+    }
+    memcpy(hdr_buff+sec_tbl_offset, infile_sections_tbl, sizeof(infile_sections_tbl));
+
+    char tmp_path[strlen(runtime.output_path) + sizeof(".XXXXXX")];
+    sprintf(tmp_path, "%s.XXXXXX", runtime.output_path);
+
+    int fd = pe_open_temp(tmp_path);
+    if (fd < 0) {
+        perror(runtime.output_path);
+        return;
+    }
 
-    /* 6. update PE header and put it */
-    if (pe.is_PE32) pe_update_and_put_headers(*pe.nt_hdr.b32, pe_buff+sizeof(dos_stub), sec_count);
-    else            pe_update_and_put_headers(*pe.nt_hdr.b64, pe_buff+sizeof(dos_stub), sec_count);
+    /* 6. size the file first, everything not written below reads as zeros */
+    bool ok = ftruncate(fd, pe_size) == 0;
+    ok = ok && pe_write_at(fd, hdr_buff, hdr_size, 0);
+    uint32_t sum = pe_checksum_partial(hdr_buff, hdr_size, 0);
 
     /* 7. flush sections */
-    memcpy(pe_buff+sec_tbl_offset, infile_sections_tbl, sizeof(infile_sections_tbl));
-    for (size_t i = 0; i < sec_count; i++) {
+    for (size_t i = 0; ok && i < sec_count; i++) {
         if (infile_sections_tbl[i].PointerToRawData) {
-            memcpy(
-                pe_buff+infile_sections_tbl[i].PointerToRawData,
-                pe.section_data[io_section_map[i]],
-                infile_sections_tbl[i].SizeOfRawData);
+            uint8_t *data = pe.section_data[io_section_map[i]];
+            size_t  len   = pe.sections[io_section_map[i]].SizeOfRawData; // the rest is padding
+
+            ok  = pe_write_at(fd, data, len, infile_sections_tbl[i].PointerToRawData);
+            sum = pe_checksum_combine(sum, pe_section_checksum(pe, io_section_map[i]));
         }
     }
 
-    /* 8. compute checksum */
-    pe_header_checksum((uint32_t *)pe_buff, pe_size);
+    /* 8. patch the checksum */
+    *checksum_ptr = pe_checksum_finalize(sum, pe_size);
+    ok = ok && pe_write_at(fd, (uint8_t *)checksum_ptr, sizeof(*checksum_ptr), (uint8_t *)checksum_ptr - hdr_buff);
 
-    /* and finally write it into a file. */
-    FILE *fp = fopen(runtime.output_path, "wb");
-    assert(fp);
-    fwrite(pe_buff, 1, pe_size, fp);
-    fclose(fp);
-    free(pe_buff);
-}
\ No newline at end of file
+    ok = close(fd) == 0 && ok;
+    ok = ok && rename(tmp_path, runtime.output_path) == 0;
+    if (!ok) {
+        perror(runtime.output_path);
+        unlink(tmp_path);
+    }
+}
@@ -20,15 +20,165 @@
 #include <cassert>
 #include <cstdlib>
 #include <cstdint>
+#include <cstring>
 
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+#include "pe.hh"
 #include "structs.h"
 
+/*  the checksum is a 32 bit one's complement sum of the file (seen as dwords)
+    folded to 16 bits, plus the file size. the sum doesn't depend on the order,
+    so it can be computed piece by piece (and cached per section).
+
+    the simd kernels add the dwords into 64 bit lanes (no carry to handle, a lane
+    would need 4G dwords to overflow) and the carries are folded back at the end. */
+
+static inline uint32_t pe_checksum_fold(uint64_t sum) {
+    while (sum >> 32)
+        sum = (sum & 0xffffffff) + (sum >> 32);
+    return (uint32_t)sum;
+}
+
+// they return how many bytes they summed (whole blocks only)
+typedef size_t (*pe_checksum_kernel_t)(uint8_t const *data, size_t len, uint64_t &sum);
+
+// the plain 32 bit end-around carry loop, faster than the 64 bit lanes without simd
+static size_t pe_checksum_scalar(uint8_t const *data, size_t len, uint64_t &sum) {
+    uint32_t sum32 = pe_checksum_fold(sum);
+    size_t i;
+
+    for (i = 0; i < (len/4); i++) {
+        uint32_t dword;
+        memcpy(&dword, data + i*4, 4);
+        sum32 += __builtin_uadd_overflow(dword,sum32,&sum32);
+    }
+    sum = sum32;
+    return i*4;
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+__attribute__((target("sse2")))
+static size_t pe_checksum_sse2(uint8_t const *data, size_t len, uint64_t &sum) {
+    __m128i zero = _mm_setzero_si128();
+    __m128i acc  = zero;
+    size_t  i;
+
+    for (i = 0; i < (len/16); i++) {
+        __m128i v = _mm_loadu_si128((__m128i const *)(data + i*16));
+        acc = _mm_add_epi64(acc, _mm_unpacklo_epi32(v, zero));
+        acc = _mm_add_epi64(acc, _mm_unpackhi_epi32(v, zero));
+    }
+
+    uint64_t lanes[2];
+    _mm_storeu_si128((__m128i *)lanes, acc);
+    sum += lanes[0] + lanes[1];
+    return i*16;
+}
+
+__attribute__((target("avx2")))
+static size_t pe_checksum_avx2(uint8_t const *data, size_t len, uint64_t &sum) {
+    __m256i zero = _mm256_setzero_si256();
+    __m256i acc0 = zero;
+    __m256i acc1 = zero;
+    size_t  i;
+
+    for (i = 0; i < (len/32); i++) {
+        __m256i v = _mm256_loadu_si256((__m256i const *)(data + i*32));
+        acc0 = _mm256_add_epi64(acc0, _mm256_unpacklo_epi32(v, zero));
+        acc1 = _mm256_add_epi64(acc1, _mm256_unpackhi_epi32(v, zero));
+    }
+
+    uint64_t lanes[4];
+    _mm256_storeu_si256((__m256i *)lanes, _mm256_add_epi64(acc0, acc1));
+    sum += lanes[0] + lanes[1] + lanes[2] + lanes[3];
+    return i*32;
+}
+#endif
+
+static pe_checksum_kernel_t pe_checksum_pick_kernel() {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+        return pe_checksum_avx2;
+    if (__builtin_cpu_supports("sse2"))
+        return pe_checksum_sse2;
+#endif
+    return pe_checksum_scalar;
+}
+
+static pe_checksum_kernel_t pe_checksum_kernel = pe_checksum_pick_kernel();
+
+// tests only: forces "scalar", "sse2" or "avx2", false if the cpu can't run it
+bool pe_checksum_use_kernel(char const *name) {
+    if (strcmp(name, "scalar") == 0) {
+        pe_checksum_kernel = pe_checksum_scalar;
+        return true;
+    }
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_cpu_init();
+    if (strcmp(name, "sse2") == 0 && __builtin_cpu_supports("sse2")) {
+        pe_checksum_kernel = pe_checksum_sse2;
+        return true;
+    }
+    if (strcmp(name, "avx2") == 0 && __builtin_cpu_supports("avx2")) {
+        pe_checksum_kernel = pe_checksum_avx2;
+        return true;
+    }
+#endif
+    return false;
+}
+
+/*  data must start on a dword boundary of the file, an incomplete last
+    dword is summed as if it was zero padded. */
+uint32_t pe_checksum_partial(uint8_t const *data, size_t len, uint32_t sum) {
+    uint64_t wide = sum;
+    size_t   done;
+
+    done  = pe_checksum_kernel(data, len, wide);
+    done += pe_checksum_scalar(data + done, len - done, wide);
+
+    if (len%4) {
+        uint32_t dword = 0;
+        memcpy(&dword, data + done, len%4);
+        wide += dword;
+    }
+
+    return pe_checksum_fold(wide);
+}
+
+uint32_t pe_checksum_combine(uint32_t a, uint32_t b) {
+    return pe_checksum_fold((uint64_t)a + b);
+}
+
+uint32_t pe_checksum_finalize(uint32_t sum, size_t size) {
+    sum = (sum&0xffff) + (sum>>16);
+    sum += (sum>>16);
+    sum &= 0xffff;
+
+    return (uint32_t)(sum+size);
+}
+
+/*  0 is never the sum of non zero data, so it means "not computed".
+    an all zero section is just summed again each time, which is free. */
+uint32_t pe_section_checksum(pe_file_t &pe, size_t idx) {
+    if (pe.section_sums[idx] == 0)
+        pe.section_sums[idx] = pe_checksum_partial(pe.section_data[idx], pe.sections[idx].SizeOfRawData, 0);
+    return pe.section_sums[idx];
+}
+
+// sums every section, so the copies made afterwards (variants) only resum what they edit
+void pe_checksum_sections(pe_file_t &pe) {
+    for (size_t i = 0; i < pe.section_count; i++)
+        pe_section_checksum(pe, i);
+}
+
 uint32_t pe_header_checksum(uint32_t *base, size_t size) {
     PIMAGE_DOS_HEADER dos;
     PIMAGE_NT_HEADERS32 nt;
     uint32_t *ptr;
-    uint32_t sum = 0;
-    size_t i;
 
     assert(size%4 == 0);
 
@@ -39,14 +189,6 @@ uint32_t pe_header_checksum(uint32_t *base, size_t size) {
         ptr = &((PIMAGE_NT_HEADERS64)nt)->OptionalHeader.CheckSum;
 
     *ptr = 0;
-
-    for (i = 0; i < (size/4); i++)
-        sum += __builtin_uadd_overflow(base[i],sum,&sum);
-
-    sum = (sum&0xffff) + (sum>>16);
-    sum += (sum>>16);
-    sum &= 0xffff;
-
-    *ptr = (uint32_t)(sum+size);
+    *ptr = pe_checksum_finalize(pe_checksum_partial((uint8_t *)base, size, 0), size);
     return *ptr;
 }
@@ -25,10 +25,13 @@
 
 #include "../pe.hh"
 
+#include "../../../Rng.hh"
+
 typedef struct {
     uint64_t start;
     uint64_t length;
     bool     must_be_encrypted;
+    bool     can_be_encrypted; // not required but harmless, gaps like this can be coalesced
 } encrypt_range_t;
 
 enum {
@@ -45,6 +48,8 @@ typedef struct {
     uint32_t key;
 } data_obfs_op_t;
 
+#define OBFS_CHUNK_SIZE (1 << 20) // unit of work of pe_obfs_encrypt_all
+
 typedef struct {
     uint64_t vaddr;
     size_t   len;
@@ -53,7 +58,11 @@ typedef struct {
 } data_obfs_ctx_t;
 
 void pe_obfs_get_ranges(pe_file_t &pe, std::vector<symbol_entry_t> functions, std::vector<encrypt_range_t> &ranges);
-bool pe_obfusc_data(pe_file_t &pe, std::vector<symbol_entry_t> functions);
-void pe_add_dec_payloads(pe_file_t &pe, std::vector<data_obfs_ctx_t> &contexts);
+void pe_obfs_get_clean_ranges(runtime_t &runtime, pe_file_t &pe, std::vector<symbol_entry_t> functions, std::vector<encrypt_range_t> &clean_ranges);
+bool pe_obfusc_data(runtime_t &runtime, pe_file_t &pe, std::vector<encrypt_range_t> &clean_ranges);
+void pe_add_dec_payloads(pe_file_t &pe, std::vector<data_obfs_ctx_t> &contexts, int stub, Rng &rng);
+void pe_obfs_encrypt_block(data_obfs_ctx_t const &ctx, uint8_t *data, size_t len);
+bool pe_obfs_use_kernel(char const *name);
+void pe_obfs_encrypt_all(std::vector<data_obfs_ctx_t> const &contexts, std::vector<uint8_t *> const &data, size_t jobs);
 
 #endif
\ No newline at end of file
@@ -24,25 +24,25 @@
 #include <cstddef>
 #include <cassert>
 #include <cstring>
+#include <cmath>
 
 #include "data_obfs.hh"
 
 #include "../pe.hh"
 #include "../structs.h"
 
-#include <x86intrin.h>
 
 static inline
-void pe_fill_obfs_ctx(data_obfs_ctx_t &ctx) {
-    ctx.op_count = (rand() % (sizeof(ctx.ops)/sizeof(ctx.ops[0]))) + 1;
+void pe_fill_obfs_ctx(data_obfs_ctx_t &ctx, Rng &rng) {
+    ctx.op_count = rng.below(sizeof(ctx.ops)/sizeof(ctx.ops[0])) + 1;
 
     auto &ops = ctx.ops;
 
     for (size_t i = 0; i < ctx.op_count; i++) {
-        ops[i].key     = rand();
+        ops[i].key     = rng();
 
         while (1) {
-            ops[i].op_type = rand() % OBFS_OP_TYPE_COUNT;
+            ops[i].op_type = rng.below(OBFS_OP_TYPE_COUNT);
             if (i == 0)
                 break; // no need to check anything for the first element
 
@@ -63,85 +63,114 @@ void pe_fill_obfs_ctx(data_obfs_ctx_t &ctx) {
         }
 
         if (ops[i].op_type == OBFS_OP_TYPE_ROL || ops[i].op_type == OBFS_OP_TYPE_ROR)
-            ctx.ops[i].key = (rand()%15) + 1; // if it is ro(l/r), it doesn't make sense to rotate 0x48548585 bits.
+            ctx.ops[i].key = rng.below(15) + 1; // if it is ro(l/r), it doesn't make sense to rotate 0x48548585 bits.
     }
 }
 
 static inline
-void pe_encrypt(pe_file_t &pe, data_obfs_ctx_t &ctx, encrypt_range_t range, uint8_t *data) {
+void pe_init_obfs_ctx(pe_file_t &pe, data_obfs_ctx_t &ctx, encrypt_range_t range, Rng &rng) {
     memset(&ctx, 0, sizeof(ctx));
 
     ctx.vaddr = range.start + PE_HDR(pe, ImageBase);
     ctx.len = range.length;
 
-    pe_fill_obfs_ctx(ctx);
+    pe_fill_obfs_ctx(ctx, rng);
 
     assert((range.start % 4) == 0);
     assert((range.length % 4) == 0);
-
-    for (size_t i = 0; i < range.length/4; i++) {
-        uint32_t tmp = ((uint32_t *)data)[i];
-        for (ssize_t j = ctx.op_count-1; j >= 0; j--) {
-            switch (ctx.ops[j].op_type) {
-                // NOTE: we encrypt so we have to do the opposite operations
-                case OBFS_OP_TYPE_ADD: tmp -= ctx.ops[j].key;            break;
-                case OBFS_OP_TYPE_SUB: tmp += ctx.ops[j].key;            break;
-                case OBFS_OP_TYPE_XOR: tmp ^= ctx.ops[j].key;            break;
-                case OBFS_OP_TYPE_ROL: tmp = _rotr(tmp, ctx.ops[j].key); break;
-                case OBFS_OP_TYPE_ROR: tmp = _rotl(tmp, ctx.ops[j].key); break;
-            }
-        }
-        ((uint32_t *)data)[i] = tmp;
-    }
 }
 
+/*  the keys are drawn first, in range order, so they don't depend on the thread count.
+    the ranges are disjoint, so they can then be encrypted in any order. */
 static inline
-void pe_obfs_encrypt_ranges(pe_file_t &pe, std::vector<encrypt_range_t> &ranges, std::vector<data_obfs_ctx_t> &contexts) {
+void pe_obfs_encrypt_ranges(pe_file_t &pe, std::vector<encrypt_range_t> &ranges, std::vector<data_obfs_ctx_t> &contexts, Rng &rng, size_t jobs) {
+    std::vector<uint8_t *> data;
+
     for (auto &range : ranges) {
-        uint8_t *ptr = (uint8_t *)pe_ptr_from_rva(pe, range.start);
-        
         data_obfs_ctx_t ctx;
-        pe_encrypt(pe, ctx, range, ptr);
+        pe_init_obfs_ctx(pe, ctx, range, rng);
         contexts.push_back(ctx);
+        data.push_back((uint8_t *)pe_ptr_from_rva(pe, range.start));
+        pe_dirty_rva(pe, range.start); // a range never spans two sections
+    }
+
+    pe_obfs_encrypt_all(contexts, data, jobs);
+}
+
+/*  rough cost of one more range in the decryption stub (code bytes + setup instructions)
+    and of each decrypted dword (instructions), see dec_payload.cc */
+static void pe_dec_stub_costs(int stub, double &per_range, double &per_dword) {
+    switch (stub) {
+        case DEC_STUB_UNROLLED: per_range = 200; per_dword = 6.5; break;
+        case DEC_STUB_SIMD:     per_range = 150; per_dword = 2.5; break;
+        case DEC_STUB_TABLE:    per_range = 86;  per_dword = 25;  break;
+        default:                per_range = 50;  per_dword = 8;   break;
     }
 }
 
-bool pe_obfusc_data(pe_file_t &pe, std::vector<symbol_entry_t> functions) {
+/*  deterministic part, it doesn't touch the section content so it can be shared by every variant.
+    two ranges of a section are coalesced when the gap between them is harmless to encrypt
+    (see can_be_encrypted) and decrypting it costs less than another range (--coalesce-weight). */
+void pe_obfs_get_clean_ranges(runtime_t &runtime, pe_file_t &pe, std::vector<symbol_entry_t> functions, std::vector<encrypt_range_t> &clean_ranges) {
     std::vector<encrypt_range_t> ranges;
-    std::vector<encrypt_range_t> clean_ranges;
+    double per_range, per_dword;
 
     pe_obfs_get_ranges(pe, functions, ranges);
+    pe_dec_stub_costs(runtime.dec_stub, per_range, per_dword);
 
     for (size_t i = 0; i < pe.section_count; i++) {
         uint64_t rva       = pe.sections[i].VirtualAddress;
-        uint8_t  *secdt    = pe.section_data[i];
-        size_t   cur_range = 0;
+        size_t   first     = clean_ranges.size(); // first range of this section
+        bool     gap_safe  = true;
 
         if (memcmp(pe.sections[i].Name, ".rdata", 6) && memcmp(pe.sections[i].Name, ".data", 5))
             continue;
 
         for (size_t j = 0; j < ranges.size(); j++) {
-            if ((!ranges[j].must_be_encrypted)|| rva > (ranges[j].start + ranges[j].length))
+            if (rva > (ranges[j].start + ranges[j].length))
                 continue;
             if (ranges[j].start > (rva + pe.sections[i].SizeOfRawData))
                 break;
+            if (!ranges[j].must_be_encrypted) {
+                gap_safe = gap_safe && ranges[j].can_be_encrypted;
+                continue;
+            }
 
             pe.sections[i].Characteristics |= IMAGE_SCN_MEM_WRITE; // TODO: use virtualprotect
             uint64_t start = std::max(rva, ranges[j].start);
+            uint64_t end   = start + std::min(
+                    (uint64_t)pe.sections[i].SizeOfRawData - (start - pe.sections[i].VirtualAddress),
+                    ranges[j].start + ranges[j].length - start);
+
+            if (clean_ranges.size() > first && gap_safe) {
+                encrypt_range_t &prev = clean_ranges.back();
+                uint64_t         gap  = start - (prev.start + prev.length);
+
+                // inf = never coalesce, not even touching ranges
+                if (!std::isinf(runtime.coalesce_weight) &&
+                    (gap/4) * per_dword * runtime.coalesce_weight <= per_range) {
+                    prev.length = end - prev.start;
+                    gap_safe    = true;
+                    continue;
+                }
+            }
 
             clean_ranges.push_back(encrypt_range_t{
                 .start  = start,
-                .length = std::min(
-                    (uint64_t)pe.sections[i].SizeOfRawData - (start - pe.sections[i].VirtualAddress),
-                    ranges[j].start + ranges[j].length - start),
+                .length = end - start,
                 .must_be_encrypted = true,
             });
+            gap_safe = true;
         }
     }
+}
+
+bool pe_obfusc_data(runtime_t &runtime, pe_file_t &pe, std::vector<encrypt_range_t> &clean_ranges) {
+    Rng rng(runtime.seed, RNG_STREAM(RNG_STREAM_DATA_OBFS, 0));
 
     std::vector<data_obfs_ctx_t> contexts;
-    pe_obfs_encrypt_ranges(pe, clean_ranges, contexts);
-    pe_add_dec_payloads(pe, contexts);
+    pe_obfs_encrypt_ranges(pe, clean_ranges, contexts, rng, runtime.jobs);
+    pe_add_dec_payloads(pe, contexts, runtime.dec_stub, rng);
 
     return true;
 }
\ No newline at end of file
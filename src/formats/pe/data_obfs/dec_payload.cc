@@ -18,45 +18,22 @@
 **/
 
 #include <cassert>
+#include <cstddef>
+#include <algorithm>
 #include <cstdlib>
+#include <initializer_list>
 #include <string.h>
 #include <vector>
 
 #include "data_obfs.hh"
 
 #include "../../../third/zydis/Zydis.h"
+#include "../../../arch/x86/emitter.hh"
+#include "../../../arch/x86/polymorph.hh"
 #include "../../../arch/x86/registers.h"
 
-// TODO: optimize
 static inline
-uint64_t pe_add_instr_to_text(pe_file_t &pe, ZydisEncoderRequest &req) {
-    ZyanU8      buff[ZYDIS_MAX_INSTRUCTION_LENGTH];
-    ZyanUSize   bufflen = ZYDIS_MAX_INSTRUCTION_LENGTH;
-
-    assert(ZYAN_SUCCESS(ZydisEncoderEncodeInstruction(&req, buff, &bufflen)));
-
-    uintptr_t ret = pe_append_section(pe, ".text", buff, bufflen);
-    assert(ret && "dec payload add");
-
-    return ((uint64_t)ret);
-}
-
-// TODO: optimize
-static inline
-uint64_t pe_add_instr_to_text_abs(pe_file_t &pe, ZydisEncoderRequest &req, uint64_t vaddr) {
-    ZyanU8      buff[ZYDIS_MAX_INSTRUCTION_LENGTH];
-    ZyanUSize   bufflen = ZYDIS_MAX_INSTRUCTION_LENGTH;
-
-    assert(ZYAN_SUCCESS(ZydisEncoderEncodeInstructionAbsolute(&req, buff, &bufflen, vaddr)));
-
-    uintptr_t ret = pe_append_section(pe, ".text", buff, bufflen);
-    assert(ret && "dec payload add");
-
-    return ((uint64_t)ret);
-}
-
-static inline
-int pe_get_random_reg(bool can_be_null) {
+int pe_get_random_reg(bool can_be_null, Rng &rng) {
     return ((int[]){
             REG_RAX,
             REG_RBX,
@@ -64,7 +41,7 @@ int pe_get_random_reg(bool can_be_null) {
             REG_RDX,
             REG_RDI,
             REG_RSI,
-            REG_NONE}[rand()%(6+can_be_null)]);
+            REG_NONE}[rng.below(6+can_be_null)]);
 }
 
 static inline
@@ -73,166 +50,370 @@ void pe_set_regs(
     ZydisRegister &buf_reg,
     ZydisRegister &base_reg,
     size_t bufsz,
-    size_t addrsz
+    size_t addrsz,
+    Rng &rng
 ) {
     int idx, buf, base;
 
-    idx = pe_get_random_reg(false);
-    buf = pe_get_random_reg(false);
-    while (idx == buf) buf = pe_get_random_reg(false);
+    idx = pe_get_random_reg(false, rng);
+    buf = pe_get_random_reg(false, rng);
+    while (idx == buf) buf = pe_get_random_reg(false, rng);
     // TODO: can be null + use RIP (in 64) or displacement (in 32)
-    base = pe_get_random_reg(false);
-    while (base == buf || base == idx) base = pe_get_random_reg(false);
+    base = pe_get_random_reg(false, rng);
+    while (base == buf || base == idx) base = pe_get_random_reg(false, rng);
 
     idx_reg  = (ZydisRegister)x86_get_register_by_size(idx, addrsz);
     base_reg = (ZydisRegister)x86_get_register_by_size(base, addrsz);
     buf_reg  = (ZydisRegister)x86_get_register_by_size(buf, bufsz);
 }
 
+typedef struct {
+    ZydisRegister       idx_reg;
+    ZydisRegister       buf_reg;
+    ZydisRegister       base_reg;
+    size_t              idx_scale;
+    ZydisEncoderOperand mempos; // [base + idx*scale + displacement], the current dword
+} dec_loop_t;
+
+static inline
+ZydisEncoderOperand pe_reg_op(ZydisRegister reg) {
+    ZydisEncoderOperand op;
+    memset(&op, 0, sizeof(op));
+    op.type      = ZYDIS_OPERAND_TYPE_REGISTER;
+    op.reg.value = reg;
+    return op;
+}
+
+static inline
+ZydisEncoderOperand pe_imm_op(uint64_t imm) {
+    ZydisEncoderOperand op;
+    memset(&op, 0, sizeof(op));
+    op.type  = ZYDIS_OPERAND_TYPE_IMMEDIATE;
+    op.imm.u = imm;
+    return op;
+}
+
+// offset is in bytes from the current dword
+static inline
+ZydisEncoderOperand pe_mem_op(dec_loop_t &loop, int64_t offset, uint16_t size) {
+    ZydisEncoderOperand op = loop.mempos;
+    op.mem.displacement += offset;
+    op.mem.size          = size;
+    return op;
+}
+
+static inline
+void pe_emit(x86_emitter_t &em, ZydisMnemonic mnemonic, std::initializer_list<ZydisEncoderOperand> operands) {
+    ZydisEncoderRequest req;
+    memset(&req, 0, sizeof(req));
+
+    req.machine_mode  = em.mode;
+    req.mnemonic      = mnemonic;
+    req.operand_count = operands.size();
+    std::copy(operands.begin(), operands.end(), req.operands);
+    x86_emit(em, req);
+}
+
+// buf = decrypt(buf)
+static inline
+void pe_emit_dec_ops(x86_emitter_t &em, dec_loop_t &loop, data_obfs_ctx_t &ctx) {
+    for (size_t j = 0; j < ctx.op_count; j++) {
+        ZydisMnemonic mnemonic = ZYDIS_MNEMONIC_INVALID;
+        switch (ctx.ops[j].op_type) {
+            case OBFS_OP_TYPE_ADD: mnemonic = ZYDIS_MNEMONIC_ADD; break;
+            case OBFS_OP_TYPE_SUB: mnemonic = ZYDIS_MNEMONIC_SUB; break;
+            case OBFS_OP_TYPE_XOR: mnemonic = ZYDIS_MNEMONIC_XOR; break;
+            case OBFS_OP_TYPE_ROL: mnemonic = ZYDIS_MNEMONIC_ROL; break;
+            case OBFS_OP_TYPE_ROR: mnemonic = ZYDIS_MNEMONIC_ROR; break;}
+        pe_emit(em, mnemonic, {pe_reg_op(loop.buf_reg), pe_imm_op(ctx.ops[j].key)});
+    }
+}
+
+static inline
+void pe_emit_dec_dword(x86_emitter_t &em, dec_loop_t &loop, data_obfs_ctx_t &ctx, int64_t offset) {
+    pe_emit(em, ZYDIS_MNEMONIC_MOV, {pe_reg_op(loop.buf_reg), pe_mem_op(loop, offset, 4)});
+    pe_emit_dec_ops(em, loop, ctx);
+    pe_emit(em, ZYDIS_MNEMONIC_MOV, {pe_mem_op(loop, offset, 4), pe_reg_op(loop.buf_reg)});
+}
+
+// idx += bytes, then loop while idx < end (in bytes)
+static inline
+void pe_emit_dec_loop_end(x86_emitter_t &em, dec_loop_t &loop, size_t bytes, size_t end, int loop_start, Rng &rng) {
+    size_t step = bytes/loop.idx_scale;
+
+    if (step == 1 && rng.below(2) == 0) // use inc if scale == 4, else use add
+        pe_emit(em, ZYDIS_MNEMONIC_INC, {pe_reg_op(loop.idx_reg)});
+    else
+        pe_emit(em, ZYDIS_MNEMONIC_ADD, {pe_reg_op(loop.idx_reg), pe_imm_op(step)});
+    // TODO: we can also use lea
+
+    pe_emit(em, ZYDIS_MNEMONIC_CMP, {pe_reg_op(loop.idx_reg), pe_imm_op(end/loop.idx_scale)});
+    x86_emit_branch(em, ZYDIS_MNEMONIC_JL, loop_start);
+}
+
+// one dword per iteration
 static inline
-void pe_dec_payload(pe_file_t &pe, data_obfs_ctx_t &ctx, ZydisMachineMode mode) {
-    ZydisRegister idx_reg;
-    ZydisRegister buf_reg;
-    ZydisRegister base_reg;
+void pe_dec_stub_loop(x86_emitter_t &em, dec_loop_t &loop, data_obfs_ctx_t &ctx, Rng &rng) {
+    int loop_start = x86_new_label(em);
+    x86_bind_label(em, loop_start);
+
+    pe_emit_dec_dword(em, loop, ctx, 0);
+    pe_emit_dec_loop_end(em, loop, 4, ctx.len, loop_start, rng);
+}
+
+// 4 or 8 dwords per iteration, the remaining dwords are done after the loop
+static inline
+void pe_dec_stub_unrolled(x86_emitter_t &em, dec_loop_t &loop, data_obfs_ctx_t &ctx, Rng &rng) {
+    size_t unroll = 4 << rng.below(2);
+    size_t main   = ctx.len - ctx.len % (unroll*4);
+
+    if (main) {
+        int loop_start = x86_new_label(em);
+        x86_bind_label(em, loop_start);
+
+        for (size_t k = 0; k < unroll; k++)
+            pe_emit_dec_dword(em, loop, ctx, k*4);
+        pe_emit_dec_loop_end(em, loop, unroll*4, main, loop_start, rng);
+    }
+
+    // idx is now main/scale (or still 0)
+    for (size_t off = 0; off < ctx.len - main; off += 4)
+        pe_emit_dec_dword(em, loop, ctx, off);
+}
+
+/*  16 bytes per iteration with sse2: xmm0 is the block, xmm1 a temporary
+    for the rotations and xmm2+ hold the broadcasted keys. */
+static inline
+void pe_dec_stub_simd(x86_emitter_t &em, dec_loop_t &loop, data_obfs_ctx_t &ctx, Rng &rng) {
+    ZydisRegister const block = ZYDIS_REGISTER_XMM0;
+    ZydisRegister const tmp   = ZYDIS_REGISTER_XMM1;
+    size_t main = ctx.len & ~(size_t)15;
+
+    if (main) {
+        for (size_t j = 0; j < ctx.op_count; j++) {
+            if (ctx.ops[j].op_type == OBFS_OP_TYPE_ROL || ctx.ops[j].op_type == OBFS_OP_TYPE_ROR)
+                continue;
+            ZydisRegister key = (ZydisRegister)(ZYDIS_REGISTER_XMM2 + j);
+            pe_emit(em, ZYDIS_MNEMONIC_MOV,    {pe_reg_op(loop.buf_reg), pe_imm_op(ctx.ops[j].key)});
+            pe_emit(em, ZYDIS_MNEMONIC_MOVD,   {pe_reg_op(key), pe_reg_op(loop.buf_reg)});
+            pe_emit(em, ZYDIS_MNEMONIC_PSHUFD, {pe_reg_op(key), pe_reg_op(key), pe_imm_op(0)});
+        }
+
+        int loop_start = x86_new_label(em);
+        x86_bind_label(em, loop_start);
+
+        pe_emit(em, ZYDIS_MNEMONIC_MOVDQU, {pe_reg_op(block), pe_mem_op(loop, 0, 16)});
+        for (size_t j = 0; j < ctx.op_count; j++) {
+            ZydisRegister key = (ZydisRegister)(ZYDIS_REGISTER_XMM2 + j);
+            uint32_t      rot = ctx.ops[j].key;
+
+            switch (ctx.ops[j].op_type) {
+                case OBFS_OP_TYPE_ADD: pe_emit(em, ZYDIS_MNEMONIC_PADDD, {pe_reg_op(block), pe_reg_op(key)}); break;
+                case OBFS_OP_TYPE_SUB: pe_emit(em, ZYDIS_MNEMONIC_PSUBD, {pe_reg_op(block), pe_reg_op(key)}); break;
+                case OBFS_OP_TYPE_XOR: pe_emit(em, ZYDIS_MNEMONIC_PXOR,  {pe_reg_op(block), pe_reg_op(key)}); break;
+                case OBFS_OP_TYPE_ROR: rot = 32 - rot; // fallthrough
+                case OBFS_OP_TYPE_ROL:
+                    pe_emit(em, ZYDIS_MNEMONIC_MOVDQA, {pe_reg_op(tmp),   pe_reg_op(block)});
+                    pe_emit(em, ZYDIS_MNEMONIC_PSLLD,  {pe_reg_op(block), pe_imm_op(rot)});
+                    pe_emit(em, ZYDIS_MNEMONIC_PSRLD,  {pe_reg_op(tmp),   pe_imm_op(32 - rot)});
+                    pe_emit(em, ZYDIS_MNEMONIC_POR,    {pe_reg_op(block), pe_reg_op(tmp)});
+                    break;
+            }
+        }
+        pe_emit(em, ZYDIS_MNEMONIC_MOVDQU, {pe_mem_op(loop, 0, 16), pe_reg_op(block)});
+        pe_emit_dec_loop_end(em, loop, 16, main, loop_start, rng);
+    }
+
+    // scalar tail (at most 3 dwords), idx is now main/scale (or still 0)
+    for (size_t off = 0; off < ctx.len - main; off += 4)
+        pe_emit_dec_dword(em, loop, ctx, off);
+}
+
+static inline
+void pe_dec_payload(pe_file_t &pe, x86_emitter_t &em, data_obfs_ctx_t &ctx, int stub, Rng &rng) {
+    dec_loop_t loop;
 
     uint64_t displacement = 0;
-    if (ctx.vaddr&0xFFF && (rand() % 2) == 0) {
+    if (ctx.vaddr&0xFFF && rng.below(2) == 0) {
         // if it is not aligned we fake an aligned buffer with displacement
         // (actually the real check would be to check if it is at the begin of a section but i am too lazy to do that)
         uint64_t aligned_vaddr = ctx.vaddr&(~(uint64_t)0xFFF);
     
         // take random aligned base addr 
-        uint64_t base_addr = (aligned_vaddr + (rand() % (ctx.vaddr - aligned_vaddr))) & ~(uint64_t)0xF;
+        uint64_t base_addr = (aligned_vaddr + rng.below(ctx.vaddr - aligned_vaddr)) & ~(uint64_t)0xF;
 
         // just compute the displacement
         displacement = ctx.vaddr - base_addr;
     }
 
-    size_t idx_scale = 1<<(rand()%3); // 1, 2 or 4.
+    loop.idx_scale = 1<<rng.below(3); // 1, 2 or 4.
     pe_set_regs(
-        idx_reg, buf_reg, base_reg, 4,
-        (PE_HDR(pe, ImageBase) > 0xFFFFFFFF) ? 8 : 4);
+        loop.idx_reg, loop.buf_reg, loop.base_reg, 4,
+        (PE_HDR(pe, ImageBase) > 0xFFFFFFFF) ? 8 : 4, rng);
 
     /* generate the operand to get the target address independentely because we use it twice */
-    ZydisEncoderOperand mempos_operand;
-    memset(&mempos_operand, 0, sizeof(mempos_operand));
-    mempos_operand.type             = ZYDIS_OPERAND_TYPE_MEMORY;
-    mempos_operand.mem.base         = base_reg;
-    mempos_operand.mem.index        = idx_reg;
-    mempos_operand.mem.scale        = idx_scale;
-    mempos_operand.mem.displacement = displacement;
-    mempos_operand.mem.size         = 4;
-
-    ZydisEncoderRequest req;
-    memset(&req, 0, sizeof(req));
-
-    req.machine_mode          = mode; // TODO: can also use mov/lea
-    req.mnemonic              = ZYDIS_MNEMONIC_XOR;
-    req.operand_count         = 2;
-    req.operands[0].type      = ZYDIS_OPERAND_TYPE_REGISTER;
-    req.operands[0].reg.value = idx_reg;
-    req.operands[1].type      = ZYDIS_OPERAND_TYPE_REGISTER;
-    req.operands[1].reg.value = idx_reg;
-    pe_add_instr_to_text(pe, req);
-
-    req.machine_mode          = mode;
-    req.mnemonic              = ZYDIS_MNEMONIC_MOV;
-    req.operand_count         = 2;
-    req.operands[0].type      = ZYDIS_OPERAND_TYPE_REGISTER;
-    req.operands[0].reg.value = base_reg;
-    req.operands[1].type      = ZYDIS_OPERAND_TYPE_IMMEDIATE;
-    req.operands[1].imm.u     = ctx.vaddr - displacement;
-    pe_add_instr_to_text(pe, req);
-
-    memset(&req, 0, sizeof(req));
-    req.machine_mode          = mode;
-    req.mnemonic              = ZYDIS_MNEMONIC_MOV;
-    req.operand_count         = 2;
-    req.operands[0].type      = ZYDIS_OPERAND_TYPE_REGISTER;
-    req.operands[0].reg.value = buf_reg;
-    req.operands[1]           = mempos_operand;
-    uint64_t loop_start = pe_add_instr_to_text(pe, req);
-
-    for (size_t j = 0; j < ctx.op_count; j++) {
-        req.machine_mode = mode;
-        req.operand_count         = 2;
-        req.operands[0].type      = ZYDIS_OPERAND_TYPE_REGISTER;
-        req.operands[0].reg.value = buf_reg;
-        req.operands[1].type      = ZYDIS_OPERAND_TYPE_IMMEDIATE;
-        req.operands[1].imm.u     = ctx.ops[j].key;
-        switch (ctx.ops[j].op_type) {
-            case OBFS_OP_TYPE_ADD: req.mnemonic = ZYDIS_MNEMONIC_ADD; break;
-            case OBFS_OP_TYPE_SUB: req.mnemonic = ZYDIS_MNEMONIC_SUB; break;
-            case OBFS_OP_TYPE_XOR: req.mnemonic = ZYDIS_MNEMONIC_XOR; break;
-            case OBFS_OP_TYPE_ROL: req.mnemonic = ZYDIS_MNEMONIC_ROL; break;
-            case OBFS_OP_TYPE_ROR: req.mnemonic = ZYDIS_MNEMONIC_ROR; break;}
-        pe_add_instr_to_text(pe, req);
+    memset(&loop.mempos, 0, sizeof(loop.mempos));
+    loop.mempos.type             = ZYDIS_OPERAND_TYPE_MEMORY;
+    loop.mempos.mem.base         = loop.base_reg;
+    loop.mempos.mem.index        = loop.idx_reg;
+    loop.mempos.mem.scale        = loop.idx_scale;
+    loop.mempos.mem.displacement = displacement;
+    loop.mempos.mem.size         = 4;
+
+    // TODO: can also use mov/lea
+    pe_emit(em, ZYDIS_MNEMONIC_XOR, {pe_reg_op(loop.idx_reg), pe_reg_op(loop.idx_reg)});
+    pe_emit(em, ZYDIS_MNEMONIC_MOV, {pe_reg_op(loop.base_reg), pe_imm_op(ctx.vaddr - displacement)});
+
+    switch (stub) {
+        case DEC_STUB_LOOP:     pe_dec_stub_loop(em, loop, ctx, rng);     break;
+        case DEC_STUB_UNROLLED: pe_dec_stub_unrolled(em, loop, ctx, rng); break;
+        case DEC_STUB_SIMD:     pe_dec_stub_simd(em, loop, ctx, rng);     break;
     }
+}
 
-    memset(&req, 0, sizeof(req));
-    req.machine_mode          = mode;
-    req.mnemonic              = ZYDIS_MNEMONIC_MOV;
-    req.operand_count         = 2;
-    req.operands[0]           = mempos_operand;
-    req.operands[1].type      = ZYDIS_OPERAND_TYPE_REGISTER;
-    req.operands[1].reg.value = buf_reg;
-    pe_add_instr_to_text(pe, req);
-
-    memset(&req, 0, sizeof(req)); // use inc if scale == 4, else use add
-    if (idx_scale == 4 && ((rand()%2) == 0)) {
-        req.machine_mode          = mode;
-        req.mnemonic              = ZYDIS_MNEMONIC_INC;
-        req.operand_count         = 1;
-        req.operands[0].type      = ZYDIS_OPERAND_TYPE_REGISTER;
-        req.operands[0].reg.value = idx_reg;
-        pe_add_instr_to_text(pe, req);
-    } else {
-        req.machine_mode          = mode;
-        req.mnemonic              = ZYDIS_MNEMONIC_ADD;
-        req.operand_count         = 2;
-        req.operands[0].type      = ZYDIS_OPERAND_TYPE_REGISTER;
-        req.operands[0].reg.value = idx_reg;
-        req.operands[1].type      = ZYDIS_OPERAND_TYPE_IMMEDIATE;
-        req.operands[1].imm.u     = 4/idx_scale;
-        pe_add_instr_to_text(pe, req);
-    } // TODO: we can also use lea
+/*  --dec-stub table: a single routine walks a table (in .rdata) with one entry
+    per range. each op of the chain is a step `x = rol((x + add) ^ xor, rol)`
+    where only one of the three isn't neutral, so the routine has no branch
+    on the op type. the routine stops at the end of the table (no terminator),
+    empty ranges have no entry. */
+typedef struct {
+    uint64_t vaddr; // absolute, the relocations are stripped
+    uint64_t len;
+    struct {
+        uint32_t add;
+        uint32_t xor_;
+        uint32_t rol;
+    } steps[sizeof(((data_obfs_ctx_t *)0)->ops)/sizeof(data_obfs_op_t)];
+} dec_table_entry_t;
+
+static void pe_fill_dec_table(std::vector<data_obfs_ctx_t> &contexts, std::vector<dec_table_entry_t> &table) {
+    table.clear();
+
+    for (auto &ctx : contexts) {
+        if (ctx.len == 0)
+            continue; // the routine decrypts at least one dword per entry
+        table.push_back(dec_table_entry_t{});
+
+        dec_table_entry_t &entry = table.back();
+        entry.vaddr = ctx.vaddr;
+        entry.len   = ctx.len;
+        for (size_t j = 0; j < ctx.op_count; j++) {
+            uint32_t key = ctx.ops[j].key;
+            switch (ctx.ops[j].op_type) {
+                case OBFS_OP_TYPE_ADD: entry.steps[j].add  = key;              break;
+                case OBFS_OP_TYPE_SUB: entry.steps[j].add  = -key;             break;
+                case OBFS_OP_TYPE_XOR: entry.steps[j].xor_ = key;              break;
+                case OBFS_OP_TYPE_ROL: entry.steps[j].rol  = key&31;           break;
+                case OBFS_OP_TYPE_ROR: entry.steps[j].rol  = (32 - (key&31))&31; break;
+            }
+        }
+    }
+}
 
-    memset(&req, 0, sizeof(req));
-    req.machine_mode          = mode;
-    req.mnemonic              = ZYDIS_MNEMONIC_CMP;
-    req.operand_count         = 2;
-    req.operands[0].type      = ZYDIS_OPERAND_TYPE_REGISTER;
-    req.operands[0].reg.value = idx_reg;
-    req.operands[1].type      = ZYDIS_OPERAND_TYPE_IMMEDIATE;
-    req.operands[1].imm.u     = ctx.len/idx_scale;
-    pe_add_instr_to_text(pe, req);
+static inline
+ZydisEncoderOperand pe_mem_base_op(ZydisRegister base, int64_t displacement, uint16_t size) {
+    ZydisEncoderOperand op;
+    memset(&op, 0, sizeof(op));
+    op.type             = ZYDIS_OPERAND_TYPE_MEMORY;
+    op.mem.base         = base;
+    op.mem.displacement = displacement;
+    op.mem.size         = size;
+    return op;
+}
 
-    PIMAGE_SECTION_HEADER txt_hdr;
-    assert(txt_hdr = pe_get_section(pe, ".text"));
-    uint64_t rva = txt_hdr->VirtualAddress + txt_hdr->VirtualSize;
-    memset(&req, 0, sizeof(req));
-    req.machine_mode          = mode;
-    req.mnemonic              = ZYDIS_MNEMONIC_JL;
-    req.operand_count         = 1;
-    req.operands[0].type      = ZYDIS_OPERAND_TYPE_IMMEDIATE;
-    req.operands[0].imm.u     = loop_start;
-    pe_add_instr_to_text_abs(pe, req, rva);
+/*  table: entry pointer, table_end: past the last entry, ptr: current dword,
+    end: end of the range, buf: the dword.
+    ecx holds the rotation (rol only takes cl), the other registers are random.
+    there is at least one entry and every range has at least one dword. */
+static void pe_dec_table_routine(pe_file_t &pe, x86_emitter_t &em, uint64_t table_vaddr, size_t entry_count, Rng &rng) {
+    int    regs[] = {REG_RAX, REG_RBX, REG_RDX, REG_RSI, REG_RDI};
+    size_t addrsz = (PE_HDR(pe, ImageBase) > 0xFFFFFFFF) ? 8 : 4;
+
+    std::shuffle(regs, regs + sizeof(regs)/sizeof(regs[0]), rng);
+    ZydisRegister table = (ZydisRegister)x86_get_register_by_size(regs[0], addrsz);
+    ZydisRegister ptr   = (ZydisRegister)x86_get_register_by_size(regs[1], addrsz);
+    ZydisRegister end   = (ZydisRegister)x86_get_register_by_size(regs[2], addrsz);
+    ZydisRegister buf   = (ZydisRegister)x86_get_register_by_size(regs[3], 4);
+    ZydisRegister table_end = (ZydisRegister)x86_get_register_by_size(regs[4], addrsz);
+
+    assert(entry_count > 0);
+
+    int next_entry = x86_new_label(em);
+    int next_dword = x86_new_label(em);
+
+    pe_emit(em, ZYDIS_MNEMONIC_MOV, {pe_reg_op(table), pe_imm_op(table_vaddr)});
+    pe_emit(em, ZYDIS_MNEMONIC_MOV, {pe_reg_op(table_end), pe_imm_op(table_vaddr + entry_count*sizeof(dec_table_entry_t))});
+
+    x86_bind_label(em, next_entry);
+    pe_emit(em, ZYDIS_MNEMONIC_MOV, {pe_reg_op(ptr), pe_mem_base_op(table, offsetof(dec_table_entry_t, vaddr), addrsz)});
+    pe_emit(em, ZYDIS_MNEMONIC_MOV, {pe_reg_op(end), pe_mem_base_op(table, offsetof(dec_table_entry_t, len), addrsz)});
+    pe_emit(em, ZYDIS_MNEMONIC_ADD, {pe_reg_op(end), pe_reg_op(ptr)});
+
+    x86_bind_label(em, next_dword);
+    pe_emit(em, ZYDIS_MNEMONIC_MOV, {pe_reg_op(buf), pe_mem_base_op(ptr, 0, 4)});
+    for (size_t j = 0; j < sizeof(((dec_table_entry_t *)0)->steps)/sizeof(((dec_table_entry_t *)0)->steps[0]); j++) {
+        int64_t step = offsetof(dec_table_entry_t, steps) + j*sizeof(((dec_table_entry_t *)0)->steps[0]);
+
+        pe_emit(em, ZYDIS_MNEMONIC_ADD, {pe_reg_op(buf), pe_mem_base_op(table, step + 0, 4)});
+        pe_emit(em, ZYDIS_MNEMONIC_XOR, {pe_reg_op(buf), pe_mem_base_op(table, step + 4, 4)});
+        pe_emit(em, ZYDIS_MNEMONIC_MOV, {pe_reg_op(ZYDIS_REGISTER_ECX), pe_mem_base_op(table, step + 8, 4)});
+        pe_emit(em, ZYDIS_MNEMONIC_ROL, {pe_reg_op(buf), pe_reg_op(ZYDIS_REGISTER_CL)});
+    }
+    pe_emit(em, ZYDIS_MNEMONIC_MOV, {pe_mem_base_op(ptr, 0, 4), pe_reg_op(buf)});
+    pe_emit(em, ZYDIS_MNEMONIC_ADD, {pe_reg_op(ptr), pe_imm_op(4)});
+    pe_emit(em, ZYDIS_MNEMONIC_CMP, {pe_reg_op(ptr), pe_reg_op(end)});
+    x86_emit_branch(em, ZYDIS_MNEMONIC_JB, next_dword);
+
+    pe_emit(em, ZYDIS_MNEMONIC_ADD, {pe_reg_op(table), pe_imm_op(sizeof(dec_table_entry_t))});
+    pe_emit(em, ZYDIS_MNEMONIC_CMP, {pe_reg_op(table), pe_reg_op(table_end)});
+    x86_emit_branch(em, ZYDIS_MNEMONIC_JB, next_entry);
 }
 
-void pe_add_dec_payloads(pe_file_t &pe, std::vector<data_obfs_ctx_t> &contexts) {
+void pe_add_dec_payloads(pe_file_t &pe, std::vector<data_obfs_ctx_t> &contexts, int stub, Rng &rng) {
     ZydisMachineMode mode = pe.is_PE32 ? ZYDIS_MACHINE_MODE_LONG_COMPAT_32 : ZYDIS_MACHINE_MODE_LONG_64;
+    x86_emitter_t    em;
+
+    x86_emitter_init(em, mode);
 
     uint64_t original_entry = PE_HDR(pe, AddressOfEntryPoint);
     PIMAGE_SECTION_HEADER txt_hdr;
     assert(txt_hdr = pe_get_section(pe, ".text"));
-    PE_HDR(pe, AddressOfEntryPoint) = txt_hdr->VirtualAddress + txt_hdr->VirtualSize;
+    uint64_t stub_rva = txt_hdr->VirtualAddress + txt_hdr->VirtualSize;
+
+    std::vector<dec_table_entry_t> table;
+    uintptr_t table_rva = 0;
+    if (stub == DEC_STUB_TABLE) {
+        pe_fill_dec_table(contexts, table);
+        if (!table.empty()) {
+            table_rva = pe_append_section(pe, ".rdata", (unsigned char *)table.data(), table.size()*sizeof(table[0]));
+            if (!table_rva)
+                stub = DEC_STUB_LOOP; // no room in .rdata, one loop per range then
+        }
+    }
 
-    for (auto &ctx : contexts)
-        pe_dec_payload(pe, ctx, mode);
+    if (stub == DEC_STUB_TABLE) {
+        if (!table.empty()) // else nothing to decrypt
+            pe_dec_table_routine(pe, em, table_rva + PE_HDR(pe, ImageBase), table.size(), rng);
+    } else {
+        for (auto &ctx : contexts) {
+            if (ctx.len) // the loops decrypt at least one dword
+                pe_dec_payload(pe, em, ctx, stub, rng);
+        }
+    }
 
     // jump to entry point
-    uint64_t jmp_from = txt_hdr->VirtualAddress + txt_hdr->VirtualSize + 5;
-    unsigned char buf[5] = "\xE9";
-    *(uint32_t *)&buf[1] = original_entry - jmp_from;
-    pe_append_section(pe, ".text", buf, 5);
+    x86_emit_branch_abs(em, ZYDIS_MNEMONIC_JMP, original_entry);
+
+    // the stub is appended in one go, at the end of the .text
+    x86_emitter_finish(em, stub_rva);
+    uintptr_t ret = pe_append_section(pe, ".text", em.code.data(), em.code.size());
+    assert(ret == stub_rva && "dec payload add");
+    PE_HDR(pe, AddressOfEntryPoint) = stub_rva;
+
+    // the routine is the same for every binary, so it is polyformed
+    if (stub == DEC_STUB_TABLE) {
+        Rng poly_rng(rng(), RNG_STREAM(RNG_STREAM_DATA_OBFS, 1));
+        polyform_x86((uint8_t *)pe_ptr_from_rva(pe, stub_rva), em.code.size(), mode, poly_rng);
+        pe_dirty_rva(pe, stub_rva);
+    }
 }
\ No newline at end of file
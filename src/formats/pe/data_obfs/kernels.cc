@@ -0,0 +1,206 @@
+/**
+ * This file is part of SIGPacker. SIGPacker is free software:
+ * you can redistribute it and/or modify it under the terms of
+ * the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License,
+ * or (at your option) any later version.
+ *
+ * SIGPacker is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with SIGPacker.
+ * If not, see <https://www.gnu.org/licenses/>. 
+ *
+ * Copyright 2024, 2025 5IGI0 / Ethan L. C. Lorenzetti
+**/
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+#include "data_obfs.hh"
+
+#include "../../../jobs.hh"
+
+/*  encryption = the opposite of the decryption stub, op by op in reverse order.
+    the chain is first turned into (at most 5) add/xor/rotl steps, then applied
+    to whole blocks of dwords: the op switch is paid per block and not per dword. */
+
+enum {
+    OBFS_STEP_ADD,
+    OBFS_STEP_XOR,
+    OBFS_STEP_ROTL,
+};
+
+typedef struct {
+    uint8_t  type;
+    uint32_t key;
+} obfs_step_t;
+
+typedef struct {
+    size_t      count;
+    obfs_step_t steps[sizeof(((data_obfs_ctx_t *)0)->ops)/sizeof(data_obfs_op_t)];
+} obfs_chain_t;
+
+static void pe_obfs_compile(data_obfs_ctx_t const &ctx, obfs_chain_t &chain) {
+    chain.count = 0;
+    for (ssize_t j = ctx.op_count-1; j >= 0; j--) {
+        obfs_step_t step;
+        uint32_t    key = ctx.ops[j].key;
+
+        switch (ctx.ops[j].op_type) {
+            case OBFS_OP_TYPE_ADD: step = {OBFS_STEP_ADD,  (uint32_t)-key};     break;
+            case OBFS_OP_TYPE_SUB: step = {OBFS_STEP_ADD,  key};                break;
+            case OBFS_OP_TYPE_XOR: step = {OBFS_STEP_XOR,  key};                break;
+            case OBFS_OP_TYPE_ROL: step = {OBFS_STEP_ROTL, (32 - (key&31))&31}; break; // rotr
+            case OBFS_OP_TYPE_ROR: step = {OBFS_STEP_ROTL, key&31};             break;
+            default: continue;
+        }
+
+        // two adds (or xors, or rotations) in a row are a single one
+        obfs_step_t *prev = chain.count ? &chain.steps[chain.count-1] : NULL;
+        if (prev && prev->type == step.type) {
+            if (step.type == OBFS_STEP_ADD)  prev->key += step.key;
+            if (step.type == OBFS_STEP_XOR)  prev->key ^= step.key;
+            if (step.type == OBFS_STEP_ROTL) prev->key = (prev->key + step.key)&31;
+            continue;
+        }
+        chain.steps[chain.count++] = step;
+    }
+}
+
+typedef void (*obfs_kernel_t)(obfs_chain_t const &chain, uint32_t *data, size_t count);
+
+static void pe_obfs_scalar(obfs_chain_t const &chain, uint32_t *data, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        uint32_t tmp;
+        memcpy(&tmp, &data[i], 4);
+        for (size_t j = 0; j < chain.count; j++) {
+            uint32_t key = chain.steps[j].key;
+            switch (chain.steps[j].type) {
+                case OBFS_STEP_ADD:  tmp += key; break;
+                case OBFS_STEP_XOR:  tmp ^= key; break;
+                case OBFS_STEP_ROTL: tmp = (tmp << key) | (tmp >> ((32-key)&31)); break;
+            }
+        }
+        memcpy(&data[i], &tmp, 4);
+    }
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+// 4 vectors per iteration, the tail is done by the scalar kernel
+#define OBFS_VECTOR_KERNEL(name, isa, vec, width, load, store, add, xor_, sll, srl, or_, set1)  \
+__attribute__((target(isa)))                                                                      \
+static void name(obfs_chain_t const &chain, uint32_t *data, size_t count) {                       \
+    size_t const per_iter = 4 * (width/4);                                                        \
+    size_t       i        = 0;                                                                    \
+                                                                                                  \
+    for (; i + per_iter <= count; i += per_iter) {                                                \
+        vec *ptr = (vec *)(data + i);                                                             \
+        vec v0 = load(ptr), v1 = load(ptr+1), v2 = load(ptr+2), v3 = load(ptr+3);                 \
+                                                                                                  \
+        for (size_t j = 0; j < chain.count; j++) {                                                \
+            uint32_t key = chain.steps[j].key;                                                    \
+            switch (chain.steps[j].type) {                                                        \
+                case OBFS_STEP_ADD: {                                                             \
+                    vec k = set1(key);                                                            \
+                    v0 = add(v0, k); v1 = add(v1, k); v2 = add(v2, k); v3 = add(v3, k);           \
+                    break;                                                                        \
+                }                                                                                 \
+                case OBFS_STEP_XOR: {                                                             \
+                    vec k = set1(key);                                                            \
+                    v0 = xor_(v0, k); v1 = xor_(v1, k); v2 = xor_(v2, k); v3 = xor_(v3, k);       \
+                    break;                                                                        \
+                }                                                                                 \
+                case OBFS_STEP_ROTL: {                                                            \
+                    __m128i l = _mm_cvtsi32_si128(key);                                           \
+                    __m128i r = _mm_cvtsi32_si128(32-key);                                        \
+                    v0 = or_(sll(v0, l), srl(v0, r)); v1 = or_(sll(v1, l), srl(v1, r));           \
+                    v2 = or_(sll(v2, l), srl(v2, r)); v3 = or_(sll(v3, l), srl(v3, r));           \
+                    break;                                                                        \
+                }                                                                                 \
+            }                                                                                     \
+        }                                                                                         \
+                                                                                                  \
+        store(ptr, v0); store(ptr+1, v1); store(ptr+2, v2); store(ptr+3, v3);                     \
+    }                                                                                             \
+    pe_obfs_scalar(chain, data + i, count - i);                                                   \
+}
+
+OBFS_VECTOR_KERNEL(pe_obfs_sse2, "sse2", __m128i, 16,
+    _mm_loadu_si128, _mm_storeu_si128, _mm_add_epi32, _mm_xor_si128,
+    _mm_sll_epi32, _mm_srl_epi32, _mm_or_si128, _mm_set1_epi32)
+
+OBFS_VECTOR_KERNEL(pe_obfs_avx2, "avx2", __m256i, 32,
+    _mm256_loadu_si256, _mm256_storeu_si256, _mm256_add_epi32, _mm256_xor_si256,
+    _mm256_sll_epi32, _mm256_srl_epi32, _mm256_or_si256, _mm256_set1_epi32)
+#endif
+
+static obfs_kernel_t pe_obfs_pick_kernel() {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+        return pe_obfs_avx2;
+    if (__builtin_cpu_supports("sse2"))
+        return pe_obfs_sse2;
+#endif
+    return pe_obfs_scalar;
+}
+
+static obfs_kernel_t pe_obfs_kernel = pe_obfs_pick_kernel();
+
+// tests only: forces "scalar", "sse2" or "avx2", false if the cpu can't run it
+bool pe_obfs_use_kernel(char const *name) {
+    if (strcmp(name, "scalar") == 0) {
+        pe_obfs_kernel = pe_obfs_scalar;
+        return true;
+    }
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_cpu_init();
+    if (strcmp(name, "sse2") == 0 && __builtin_cpu_supports("sse2")) {
+        pe_obfs_kernel = pe_obfs_sse2;
+        return true;
+    }
+    if (strcmp(name, "avx2") == 0 && __builtin_cpu_supports("avx2")) {
+        pe_obfs_kernel = pe_obfs_avx2;
+        return true;
+    }
+#endif
+    return false;
+}
+
+// len is a multiple of 4
+void pe_obfs_encrypt_block(data_obfs_ctx_t const &ctx, uint8_t *data, size_t len) {
+    obfs_chain_t chain;
+
+    pe_obfs_compile(ctx, chain);
+    pe_obfs_kernel(chain, (uint32_t *)data, len/4);
+}
+
+typedef struct {
+    uint8_t *data;
+    size_t  len;
+    size_t  ctx;
+} obfs_chunk_t;
+
+// data[i] is the start of contexts[i] range, big ranges are split so they spread over the threads
+void pe_obfs_encrypt_all(std::vector<data_obfs_ctx_t> const &contexts, std::vector<uint8_t *> const &data, size_t jobs) {
+    std::vector<obfs_chunk_t> chunks;
+
+    for (size_t i = 0; i < contexts.size(); i++) {
+        for (size_t off = 0; off < contexts[i].len; off += OBFS_CHUNK_SIZE)
+            chunks.push_back({data[i] + off, std::min((size_t)OBFS_CHUNK_SIZE, contexts[i].len - off), i});
+    }
+
+    run_jobs(chunks.size(), jobs, [&](size_t i) {
+        pe_obfs_encrypt_block(contexts[chunks[i].ctx], chunks[i].data, chunks[i].len);
+    });
+}
@@ -74,7 +74,8 @@ void pe_obfs_get_ranges(pe_file_t &pe, std::vector<symbol_entry_t> functions, st
             if (pe.symbols[i].N.Name.Short == 0 && memcmp(".refptr.", pe.strings + pe.symbols[i].N.Name.Long, 8) == 0) {
                 ranges.push_back(encrypt_range_t{
                 .start = *(uint64_t*)(pe.start + pe.sections[pe.symbols[i].SectionNumber-1].PointerToRawData + pe.symbols[i].Value) - PE_HDR(pe, ImageBase),
-                .must_be_encrypted = false});
+                .must_be_encrypted = false,
+                .can_be_encrypted  = true});
             }
         }
     }
@@ -96,6 +97,8 @@ void pe_obfs_get_ranges(pe_file_t &pe, std::vector<symbol_entry_t> functions, st
             )) {
             if (nit->start == it->start && it->must_be_encrypted && nit->must_be_encrypted == false)
                 std::cerr << "Warning: a buffer is shared with an non-polyform function (" << std::hex << it->start << ")" << std::endl;
+            if (!it->must_be_encrypted)
+                it->can_be_encrypted = it->can_be_encrypted && nit->can_be_encrypted;
             ranges.erase(nit);
             nit = std::next(it);
         }
@@ -19,6 +19,7 @@
 
 #include "pe.hh"
 
+#include <algorithm>
 #include <cstdlib>
 #include <cstring>
 #include <iostream>
@@ -31,10 +32,10 @@ std::vector<symbol_entry_t> pe_list_functions(pe_file_t &pe, AllowList &allowed)
         return functions;
 
     /* find all functions */
-    for (size_t i = 0; i < pe.symbol_count; i++) {
+    for (size_t i = 0; i < pe.symbol_count; i += 1 + pe.symbols[i].NumberOfAuxSymbols) {
         if ( // TODO: find all classes that use offset in sections
             (pe.symbols[i].StorageClass != IMAGE_SYM_CLASS_EXTERNAL && pe.symbols[i].StorageClass != IMAGE_SYM_CLASS_STATIC)
-            && pe.symbols[i].SectionNumber > 0)
+            || pe.symbols[i].SectionNumber <= 0) // undefined, absolute and debug symbols aren't in a section
             continue;
 
         PIMAGE_SECTION_HEADER sec = &pe.sections[pe.symbols[i].SectionNumber-1];
@@ -56,39 +57,53 @@ std::vector<symbol_entry_t> pe_list_functions(pe_file_t &pe, AllowList &allowed)
             symbol.name[8] = 0;
         }
 
-        if (symbol.raw_symbol->Type == 0x20) {
-            if (!pe.is_PE32)
-                symbol.must_poly = allowed.allowed(symbol.name);
-            else {
-                // for the same command to work in 32 and 64, ignore the leading underscore
-                // (mandatory according to the windows ABI)
-                // TODO: --no-implicit-leading-underscore (to disable it)
-                char *name = symbol.name;
-                if (name[0] != '_')
-                    std::cerr << "Warning: no leading underscore for symbol `" << symbol.name << "` (expected in 32bits)" << std::endl;
-                else
-                    name++;
-                symbol.must_poly = allowed.allowed(name);
-            }
-        }
-        
         functions.push_back(symbol);
     }
 
-    /* compute functions' size */
-    for (size_t i = 0; i < functions.size(); i++) {
-        functions[i].size = (functions[i].section->VirtualAddress + functions[i].section->SizeOfRawData) - functions[i].vaddr;
+    /*  compute functions' size: a function ends at the next symbol (at another address)
+        or at the end of its section. the symbols are sorted, the list keeps its order. */
+    std::vector<size_t> by_vaddr(functions.size());
+    for (size_t i = 0; i < functions.size(); i++)
+        by_vaddr[i] = i;
+    std::stable_sort(by_vaddr.begin(), by_vaddr.end(), [&](size_t a, size_t b) {
+        return functions[a].vaddr < functions[b].vaddr;});
 
-        for (size_t j = 0; j < functions.size(); j++) {
-            if (functions[j].vaddr != functions[i].vaddr && (functions[j].vaddr - functions[i].vaddr) < functions[i].size)
-                functions[i].size = functions[j].vaddr - functions[i].vaddr;
-        }
+    size_t next = 0; // first symbol after the current address
+    for (size_t i = 0; i < by_vaddr.size(); i++) {
+        symbol_entry_t &func = functions[by_vaddr[i]];
+
+        if (next <= i)
+            next = i+1;
+        while (next < by_vaddr.size() && functions[by_vaddr[next]].vaddr == func.vaddr)
+            next++;
+
+        func.size = (func.section->VirtualAddress + func.section->SizeOfRawData) - func.vaddr;
+        if (next < by_vaddr.size() && (functions[by_vaddr[next]].vaddr - func.vaddr) < func.size)
+            func.size = functions[by_vaddr[next]].vaddr - func.vaddr;
     }
 
-    /* check for IAT stubs */
+    /* allow list and IAT stubs, only for functions */
     for (size_t i = 0; i < functions.size(); i++) {
-        if (functions[i].raw_symbol->Type == 0x20)
-            functions[i].is_IAT_stub = pe_is_IATStub(pe, functions[i]);
+        symbol_entry_t &symbol = functions[i];
+
+        if (symbol.raw_symbol->Type != 0x20)
+            continue;
+
+        if (!pe.is_PE32)
+            symbol.must_poly = allowed.allowed(symbol.name);
+        else {
+            // for the same command to work in 32 and 64, ignore the leading underscore
+            // (mandatory according to the windows ABI)
+            // TODO: --no-implicit-leading-underscore (to disable it)
+            char *name = symbol.name;
+            if (name[0] != '_')
+                std::cerr << "Warning: no leading underscore for symbol `" << symbol.name << "` (expected in 32bits)" << std::endl;
+            else
+                name++;
+            symbol.must_poly = allowed.allowed(name);
+        }
+
+        symbol.is_IAT_stub = pe_is_IATStub(pe, symbol);
     }
 
     return functions;
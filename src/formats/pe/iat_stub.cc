@@ -22,19 +22,21 @@
 
 #include "pe.hh"
 
+#include "../../arch/x86/polymorph.hh"
 #include "../../third/zydis/Zydis.h"
 
 // TODO: maybe just check if the symbol's name is in the idata?
 bool pe_is_IATStub(pe_file_t &pe, symbol_entry_t entry) {
-    ZydisDisassembledInstruction instr;
+    x86_decoded_instr_t instr;
 
-    assert(ZYAN_SUCCESS(ZydisDisassembleIntel( // TODO: check error
-        /* machine_mode:    */ (ZydisMachineMode)(pe.is_PE32 ? ZYDIS_MACHINE_MODE_LONG_COMPAT_32 : ZYDIS_MACHINE_MODE_LONG_64),
-        /* runtime_address: */ entry.vaddr,
+    bool decoded = x86_decode_buffer( // TODO: check error
         /* buffer:          */ pe.start + entry.offset,
         /* length:          */ entry.size,
-        /* instruction:     */ &instr
-    )));
+        /* machine_mode:    */ pe.is_PE32 ? ZYDIS_MACHINE_MODE_LONG_COMPAT_32 : ZYDIS_MACHINE_MODE_LONG_64,
+        /* instruction:     */ instr
+    );
+    assert(decoded);
+    (void)decoded;
 
     // TODO: tested for mingw x86_64 / i386
     if (
@@ -80,6 +80,7 @@ void pe_dummify_imports(runtime_t &runtime, pe_file_t &pe, hidden_import_t *hidd
     PIMAGE_SECTION_HEADER idata = pe_get_section(pe, ".idata");
     PIMAGE_IMPORT_DESCRIPTOR imports = (PIMAGE_IMPORT_DESCRIPTOR)(pe.start + idata->PointerToRawData);
     std::vector<std::string> whitelist;
+    Rng rng(runtime.seed, RNG_STREAM(RNG_STREAM_IMPORTS, 1));
 
     for (size_t j = 0; 1; j++) {
         char *dll_name = pe_ptr_from_rva(pe, imports[j].Name);
@@ -106,6 +107,7 @@ void pe_dummify_imports(runtime_t &runtime, pe_file_t &pe, hidden_import_t *hidd
                 if (hidden_imports[y].IAT_addr == addr) {
                     uint16_t ordinal = import_name->Hint;
                     memset(import_name, 0, sizeof(*import_name)+strlen((char const *)import_name->Name)); // TODO: regenerate the whole string table
+                    pe_dirty_rva(pe, view_thunk[k].u1.ForwarderString);
                     // TODO: find a good ordinal value
                     uint16_t name_addr = pe_append_section(pe, ".idata", (unsigned char *)&ordinal, 2);
 
@@ -114,7 +116,7 @@ void pe_dummify_imports(runtime_t &runtime, pe_file_t &pe, hidden_import_t *hidd
                         assert(whitelist.size());
                     }
 
-                    int replacement_id = rand()%whitelist.size();
+                    int replacement_id = rng.below(whitelist.size());
                     auto replacement = whitelist[replacement_id];
                     whitelist.erase(std::next(whitelist.begin(), replacement_id));
 
@@ -124,6 +126,8 @@ void pe_dummify_imports(runtime_t &runtime, pe_file_t &pe, hidden_import_t *hidd
                     view_thunk  = (IMAGE_THUNK_DATA*)pe_ptr_from_rva(pe, imports[j].OriginalFirstThunk);
                     set_thunk   = (IMAGE_THUNK_DATA*)pe_ptr_from_rva(pe, imports[j].FirstThunk);
                     view_thunk[k].u1.ForwarderString = name_addr;
+                    pe_dirty_rva(pe, imports[j].OriginalFirstThunk); // whichever view_thunk is
+                    pe_dirty_rva(pe, imports[j].FirstThunk);
                 }
             }
         }
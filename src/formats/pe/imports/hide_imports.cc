@@ -142,10 +142,11 @@ static int pe_hide_imports_x64(runtime_t &runtime, pe_file_t &pe) {
     pe_append_section(pe, ".text", bootloader, sizeof(bootloader)-1);
 
     /* polyform */
+    Rng rng(runtime.seed, RNG_STREAM(RNG_STREAM_IMPORTS, 0));
     PIMAGE_SECTION_HEADER sec = pe_get_section(pe, ".text");
     size_t offset = sec->VirtualSize;
     size_t  sec_idx = ((char *)sec-(char *)pe.sections)/sizeof(IMAGE_SECTION_HEADER);
-    polyform_x86(pe.section_data[sec_idx]+offset, sec->VirtualSize-offset, ZYDIS_MACHINE_MODE_LONG_64);
+    polyform_x86(pe.section_data[sec_idx]+offset, sec->VirtualSize-offset, ZYDIS_MACHINE_MODE_LONG_64, rng);
 
     return 0;
 }
@@ -188,10 +189,11 @@ static int pe_hide_imports_x86(runtime_t &runtime, pe_file_t &pe) {
     pe_append_section(pe, ".text", bootloader, sizeof(bootloader));
 
     /* polyform */
+    Rng rng(runtime.seed, RNG_STREAM(RNG_STREAM_IMPORTS, 0));
     PIMAGE_SECTION_HEADER sec = pe_get_section(pe, ".text");
     size_t offset = sec->VirtualSize;
     size_t  sec_idx = ((char *)sec-(char *)pe.sections)/sizeof(IMAGE_SECTION_HEADER);
-    polyform_x86(pe.section_data[sec_idx]+offset, sec->VirtualSize-offset, ZYDIS_MACHINE_MODE_LEGACY_32);
+    polyform_x86(pe.section_data[sec_idx]+offset, sec->VirtualSize-offset, ZYDIS_MACHINE_MODE_LEGACY_32, rng);
 
     return 0;
 }
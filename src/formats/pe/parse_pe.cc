@@ -72,6 +72,12 @@ bool parse_pe(runtime_t &runtime, pe_file_t &pe) {
     pe.sections         = IMAGE_FIRST_SECTION(pe.nt_hdr.b32);
     pe.section_count    = pe.nt_hdr.b64->FileHeader.NumberOfSections;
     pe.section_data     = (uint8_t **)malloc(sizeof(uint8_t *) * pe.nt_hdr.b64->FileHeader.NumberOfSections);
+    pe.section_capacity = (size_t *)calloc(pe.nt_hdr.b64->FileHeader.NumberOfSections, sizeof(size_t));
+    pe.section_sums     = (uint32_t *)calloc(pe.nt_hdr.b64->FileHeader.NumberOfSections, sizeof(uint32_t));
+    pe.rva_index        = (pe_rva_interval_t *)malloc(sizeof(pe_rva_interval_t) * pe.nt_hdr.b64->FileHeader.NumberOfSections);
+    pe.rva_index_count  = 0;
+    pe.rva_last_hit     = 0;
+    pe.rva_index_stale  = true;
     pe.symbols          = (PIMAGE_SYMBOL)(pe.start+pe.nt_hdr.b64->FileHeader.PointerToSymbolTable);
     pe.symbol_count     = pe.nt_hdr.b64->FileHeader.NumberOfSymbols;
     pe.strings          = (char *)&pe.symbols[pe.symbol_count];
@@ -84,8 +90,11 @@ bool parse_pe(runtime_t &runtime, pe_file_t &pe) {
 
 void free_pe(pe_file_t &pe) {
     for (size_t i = 0; i < pe.section_count; i++) {
-        if (pe.section_data[i] < pe.start || pe.section_data[i] > pe.start+pe.length)
+        if (pe.section_capacity[i])
             free(pe.section_data[i]); // free enlarged sections
     }
     free(pe.section_data);
+    free(pe.section_capacity);
+    free(pe.section_sums);
+    free(pe.rva_index);
 }
\ No newline at end of file
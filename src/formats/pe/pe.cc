@@ -21,15 +21,90 @@
 #include <cstdio>
 #include <cstring>
 #include <iostream>
+#include <string>
+
+#include <sys/wait.h>
+#include <unistd.h>
 
 #include "pe.hh"
 #include "data_obfs/data_obfs.hh"
 
 #include "../../structs.hh"
 
+// out.exe -> out.3.exe
+static std::string pe_variant_path(char const *path, size_t idx) {
+    std::string out = path;
+    size_t dot   = out.rfind('.');
+    size_t slash = out.rfind('/');
+
+    if (dot == std::string::npos || (slash != std::string::npos && dot < slash))
+        dot = out.size();
+    return out.insert(dot, "." + std::to_string(idx));
+}
+
+// everything that depends on the seed, it edits the sections in place
+static bool pe_randomize(runtime_t &runtime, pe_file_t &pe, std::vector<symbol_entry_t> &functions, std::vector<encrypt_range_t> &clean_ranges) {
+    if (!pe_obfusc_data(runtime, pe, clean_ranges))     return false;
+    if (!pe_polyform_functions(runtime, pe, functions)) return false;
+
+    if (runtime.hide_imports.size())
+        pe_hide_imports(runtime, pe);
+
+    pe_build(pe, runtime);
+    return true;
+}
+
+/*  each variant is a forked child: the parsed file and the analysis are shared,
+    the section buffers are copied (by the kernel) only when a variant writes them.
+    up to --jobs variants run at once, each one polyforms on a single thread. */
+static void pe_build_variants(runtime_t &runtime, pe_file_t &pe, std::vector<symbol_entry_t> &functions, std::vector<encrypt_range_t> &clean_ranges) {
+    size_t running = 0;
+    size_t failed  = 0;
+
+    pe_checksum_sections(pe); // computed once, a variant only resums the sections it edits
+    fflush(stdout);
+    for (size_t i = 0; i < runtime.variants; i++) {
+        if (running == runtime.jobs) {
+            int status;
+            if (wait(&status) > 0 && (!WIFEXITED(status) || WEXITSTATUS(status)))
+                failed++;
+            running--;
+        }
+
+        pid_t pid = fork();
+        if (pid < 0) {
+            perror("fork");
+            failed += runtime.variants - i;
+            break;
+        }
+
+        if (pid == 0) {
+            std::string path = pe_variant_path(runtime.output_path, i);
+
+            runtime.output_path = (char *)path.c_str();
+            runtime.seed        = Rng(runtime.seed, RNG_STREAM(RNG_STREAM_VARIANT, i))();
+            runtime.jobs        = 1;
+            bool ok = pe_randomize(runtime, pe, functions, clean_ranges);
+            fflush(stdout);
+            _exit(ok ? 0 : 1);
+        }
+        running++;
+    }
+
+    for (; running; running--) {
+        int status;
+        if (wait(&status) > 0 && (!WIFEXITED(status) || WEXITSTATUS(status)))
+            failed++;
+    }
+
+    if (failed)
+        std::cerr << "Error: " << failed << " variant(s) out of " << runtime.variants << " failed." << std::endl;
+}
+
 void handle_pe(runtime_t &runtime) {
     pe_file_t pe;
     std::vector<symbol_entry_t> functions;
+    std::vector<encrypt_range_t> clean_ranges;
     AllowList polylist;
 
     if (!parse_pe(runtime, pe))                 return;
@@ -39,14 +114,14 @@ void handle_pe(runtime_t &runtime) {
         std::cerr << "Error: stripped binary." << std::endl;
         return;
     }
-    
-    if (!pe_obfusc_data(pe, functions)) return;
-    if (!pe_polyform_functions(pe, functions)) return;
 
-    if (runtime.hide_imports.size())
-        pe_hide_imports(runtime, pe);
+    pe_obfs_get_clean_ranges(runtime, pe, functions, clean_ranges);
+
+    if (runtime.variants > 1)
+        pe_build_variants(runtime, pe, functions, clean_ranges);
+    else
+        pe_randomize(runtime, pe, functions, clean_ranges);
 
     pe_free_function_list(functions);
-    pe_build(pe, runtime);
     free_pe(pe);
 }
\ No newline at end of file
@@ -29,6 +29,13 @@
 #include "../../structs.hh"
 #include "../../AllowList.hh"
 
+// raw data of a section, by rva (see pe_ptr_from_rva)
+typedef struct {
+    uint64_t                start;
+    uint64_t                end;
+    size_t                  section;
+} pe_rva_interval_t;
+
 typedef struct {
     bool                    is_PE32;
     uint8_t                 *start;
@@ -38,6 +45,12 @@ typedef struct {
     size_t                  section_count;
     PIMAGE_SECTION_HEADER   sections;
     uint8_t                 **section_data;
+    size_t                  *section_capacity; // allocated size of an enlarged section, 0 = still in the input
+    uint32_t                *section_sums; // checksum of each section's raw data, 0 = to compute
+    pe_rva_interval_t       *rva_index;     // sorted by rva, without empty sections
+    size_t                  rva_index_count;
+    size_t                  rva_last_hit;
+    bool                    rva_index_stale;
     char                    *strings;
     union {
         PIMAGE_NT_HEADERS32 b32;
@@ -58,9 +71,10 @@ typedef struct {
 
 void handle_pe(runtime_t &runtime);
 bool parse_pe(runtime_t &runtime, pe_file_t &file);
-bool pe_polyform_functions(pe_file_t &pe, std::vector<symbol_entry_t> functions);
+bool pe_polyform_functions(runtime_t &runtime, pe_file_t &pe, std::vector<symbol_entry_t> &functions);
 bool pe_is_IATStub(pe_file_t &pe, symbol_entry_t entry);
 char *pe_ptr_from_rva(pe_file_t &pe, uintptr_t rva);
+void pe_dirty_rva(pe_file_t &pe, uintptr_t rva);
 void pe_build(pe_file_t &pe, runtime_t &runtime);
 int pe_hide_imports(runtime_t &runtime, pe_file_t &pe);
 PIMAGE_SECTION_HEADER pe_get_section(pe_file_t &pe, char const *name);
@@ -70,7 +84,15 @@ void pe_free_function_list(std::vector<symbol_entry_t> &list);
 void free_pe(pe_file_t &pe);
 void pe_gen_polylist(runtime_t &runtime, AllowList &polylist);
 uint32_t pe_header_checksum(uint32_t *base, size_t size);
+uint32_t pe_checksum_partial(uint8_t const *data, size_t len, uint32_t sum);
+uint32_t pe_checksum_finalize(uint32_t sum, size_t size);
+uint32_t pe_checksum_combine(uint32_t a, uint32_t b);
+uint32_t pe_section_checksum(pe_file_t &pe, size_t idx);
+void     pe_checksum_sections(pe_file_t &pe);
+bool     pe_checksum_use_kernel(char const *name);
 
+// anything that writes a section must drop its cached checksum
+#define PE_DIRTY_SECTION(pe, idx) ((pe).section_sums[idx] = 0)
 #define PE_HDR(pe, attr) (pe.is_PE32 ? pe.nt_hdr.b32->OptionalHeader.attr : pe.nt_hdr.b64->OptionalHeader.attr)
 
 #endif
\ No newline at end of file
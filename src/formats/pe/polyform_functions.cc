@@ -17,24 +17,57 @@
  * Copyright 2024, 2025 5IGI0 / Ethan L. C. Lorenzetti
 **/
 
+#include <algorithm>
 #include <cstddef>
 #include <cstdlib>
 #include <cstring>
 #include <cstdint>
+#include <thread>
 #include <vector>
 
 #include "pe.hh"
 
 #include "../../arch/x86/polymorph.hh"
+#include "../../jobs.hh"
 #include "structs.h"
 
-bool pe_polyform_functions(pe_file_t &pe, std::vector<symbol_entry_t> functions) {
+typedef struct {
+    uint8_t     *code;
+    size_t      size;
+    Rng         rng;
+} pe_poly_job_t;
+
+bool pe_polyform_functions(runtime_t &runtime, pe_file_t &pe, std::vector<symbol_entry_t> &functions) {
+    std::vector<pe_poly_job_t> jobs;
+    int mode = pe.is_PE32 ? ZYDIS_MACHINE_MODE_LONG_COMPAT_32 : ZYDIS_MACHINE_MODE_LONG_64;
+
+    /*  each function has its own random stream (keyed by its address),
+        so the output doesn't depend on how the jobs are scheduled */
     for (size_t i = 0; i < functions.size(); i++) {
         if (functions[i].raw_symbol->Type != 0x20 || functions[i].is_IAT_stub || !functions[i].must_poly) {continue;}
-        uint8_t *func_code = pe.start + functions[i].offset;
 
-        polyform_x86(func_code, functions[i].size, pe.is_PE32 ? ZYDIS_MACHINE_MODE_LONG_COMPAT_32 : ZYDIS_MACHINE_MODE_LONG_64);
+        // the section may have been moved by pe_append_section, don't use pe.start
+        size_t   sec_idx   = functions[i].section - pe.sections;
+        uint8_t *func_code = pe.section_data[sec_idx] + (functions[i].vaddr - functions[i].section->VirtualAddress);
+        Rng      rng(runtime.seed, RNG_STREAM(RNG_STREAM_POLYFORM, functions[i].vaddr));
+        PE_DIRTY_SECTION(pe, sec_idx);
+
+        jobs.push_back({func_code, functions[i].size, rng});
     }
-    
+
+    // the ranges are disjoint, except for aliases (several symbols at the same address)
+    std::stable_sort(jobs.begin(), jobs.end(), [](pe_poly_job_t const &a, pe_poly_job_t const &b) {
+        return a.code < b.code;});
+    jobs.erase(std::unique(jobs.begin(), jobs.end(), [](pe_poly_job_t const &a, pe_poly_job_t const &b) {
+        return a.code == b.code;}), jobs.end());
+
+    // largest first, so a big function doesn't start last
+    std::stable_sort(jobs.begin(), jobs.end(), [](pe_poly_job_t const &a, pe_poly_job_t const &b) {
+        return a.size > b.size;});
+
+    run_jobs(jobs.size(), runtime.jobs, [&](size_t i) {
+        polyform_x86(jobs[i].code, jobs[i].size, mode, jobs[i].rng);
+    });
+
     return true;
-}
\ No newline at end of file
+}
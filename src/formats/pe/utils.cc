@@ -17,6 +17,7 @@
  * Copyright 2024, 2025 5IGI0 / Ethan L. C. Lorenzetti
 **/
 
+#include <algorithm>
 #include <cassert>
 #include <cstddef>
 #include <cstdint>
@@ -27,12 +28,61 @@
 #include "pe.hh"
 #include "structs.h"
 
-char *pe_ptr_from_rva(pe_file_t &pe, uintptr_t rva) {
+static void pe_build_rva_index(pe_file_t &pe) {
+    pe.rva_index_count = 0;
     for (size_t i = 0; i < pe.section_count; i++) {
-        if (rva >= pe.sections[i].VirtualAddress && rva < pe.sections[i].VirtualAddress+pe.sections[i].SizeOfRawData)
-            return (char *)(pe.section_data[i] + (rva - pe.sections[i].VirtualAddress));
+        if (pe.sections[i].SizeOfRawData == 0)
+            continue;
+        pe.rva_index[pe.rva_index_count++] = pe_rva_interval_t{
+            .start   = pe.sections[i].VirtualAddress,
+            .end     = (uint64_t)pe.sections[i].VirtualAddress + pe.sections[i].SizeOfRawData,
+            .section = i,
+        };
     }
-    return NULL;
+
+    std::stable_sort(pe.rva_index, pe.rva_index + pe.rva_index_count, [](pe_rva_interval_t const &a, pe_rva_interval_t const &b) {
+        return a.start < b.start;});
+    pe.rva_last_hit    = 0;
+    pe.rva_index_stale = false;
+}
+
+/*  called per thunk / name / range, the lookups mostly hit the same section
+    so the last hit is tried before the binary search. */
+static pe_rva_interval_t *pe_find_rva(pe_file_t &pe, uintptr_t rva) {
+    if (pe.rva_index_stale)
+        pe_build_rva_index(pe);
+
+    pe_rva_interval_t *hit = NULL;
+    if (pe.rva_last_hit < pe.rva_index_count &&
+        rva >= pe.rva_index[pe.rva_last_hit].start && rva < pe.rva_index[pe.rva_last_hit].end) {
+        hit = &pe.rva_index[pe.rva_last_hit];
+    } else {
+        // last interval starting at or before rva
+        pe_rva_interval_t *it = std::upper_bound(pe.rva_index, pe.rva_index + pe.rva_index_count, rva,
+            [](uintptr_t rva, pe_rva_interval_t const &interval) {return rva < interval.start;});
+        if (it == pe.rva_index || rva >= (it-1)->end)
+            return NULL;
+        hit = it-1;
+        pe.rva_last_hit = hit - pe.rva_index;
+    }
+    return hit;
+}
+
+// read only, see pe_dirty_rva
+char *pe_ptr_from_rva(pe_file_t &pe, uintptr_t rva) {
+    pe_rva_interval_t *hit = pe_find_rva(pe, rva);
+
+    if (hit == NULL)
+        return NULL;
+    return (char *)(pe.section_data[hit->section] + (rva - hit->start));
+}
+
+// drops the cached checksum of the section holding rva, after writing through pe_ptr_from_rva
+void pe_dirty_rva(pe_file_t &pe, uintptr_t rva) {
+    pe_rva_interval_t *hit = pe_find_rva(pe, rva);
+
+    if (hit)
+        PE_DIRTY_SECTION(pe, hit->section);
 }
 
 PIMAGE_SECTION_HEADER pe_get_section(pe_file_t &pe, char const *name) {
@@ -74,20 +124,38 @@ uintptr_t pe_append_section(pe_file_t &pe, char const *name, unsigned char const
     uint8_t *ptr        = pe.section_data[sec_idx];
     size_t  offset      = sec->VirtualSize;
 
-    if ((datalen + offset) > sec->SizeOfRawData) {
-        // FAUT ROUND ALLOCATED
-        sec->SizeOfRawData = ((((size_t)(datalen + offset))-1)|(0x200-1))+1;
-        if (ptr >= pe.start && ptr < (pe.start + pe.length)) {
-            ptr = (uint8_t *)malloc(sec->SizeOfRawData);
-            memcpy(ptr, pe.section_data[sec_idx], offset);
-            pe.section_data[sec_idx] = ptr;
+    size_t  needed      = offset + datalen;
+
+    /*  SizeOfRawData follows the content (it is rounded to FileAlignment by pe_build),
+        the buffer itself grows geometrically so appends are amortised O(1). */
+    if (needed > pe.section_capacity[sec_idx] && (pe.section_capacity[sec_idx] || needed > sec->SizeOfRawData)) {
+        size_t capacity = std::max(needed, std::max((size_t)sec->SizeOfRawData, pe.section_capacity[sec_idx]*2));
+        capacity = ((capacity-1)|(0x200-1))+1;
+
+        if (pe.section_capacity[sec_idx] == 0) {
+            // first growth, copy the section out of the input
+            ptr = (uint8_t *)calloc(1, capacity);
+            memcpy(ptr, pe.section_data[sec_idx], std::min(offset, (size_t)sec->SizeOfRawData));
         } else {
-            ptr = (uint8_t *)realloc(ptr, sec->SizeOfRawData);
-            pe.section_data[sec_idx] = ptr;
+            ptr = (uint8_t *)realloc(ptr, capacity);
+            memset(ptr + pe.section_capacity[sec_idx], 0, capacity - pe.section_capacity[sec_idx]);
+        }
+        pe.section_data[sec_idx]     = ptr;
+        pe.section_capacity[sec_idx] = capacity;
+    }
+
+    if (needed > sec->SizeOfRawData) {
+        if (sec->SizeOfRawData == 0)
+            pe.rva_index_stale = true; // it was empty, so it isn't indexed
+        sec->SizeOfRawData = needed;
+        for (size_t i = 0; i < pe.rva_index_count; i++) {
+            if (pe.rva_index[i].section == sec_idx)
+                pe.rva_index[i].end = (uint64_t)sec->VirtualAddress + needed;
         }
     }
 
     memcpy(ptr + offset, data, datalen);
+    PE_DIRTY_SECTION(pe, sec_idx);
     sec->VirtualSize = offset + datalen;
     return sec->VirtualAddress + offset;
 }
\ No newline at end of file
@@ -0,0 +1,44 @@
+/**
+ * This file is part of SIGPacker. SIGPacker is free software:
+ * you can redistribute it and/or modify it under the terms of
+ * the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License,
+ * or (at your option) any later version.
+ *
+ * SIGPacker is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with SIGPacker.
+ * If not, see <https://www.gnu.org/licenses/>. 
+ *
+ * Copyright 2024, 2025 5IGI0 / Ethan L. C. Lorenzetti
+**/
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include "jobs.hh"
+
+void run_jobs(size_t count, size_t thread_count, std::function<void(size_t)> const &job) {
+    std::atomic<size_t>         next(0);
+    std::vector<std::thread>    threads;
+
+    auto worker = [&]() {
+        for (size_t i = next++; i < count; i = next++)
+            job(i);
+    };
+
+    if (thread_count > count)
+        thread_count = count;
+
+    for (size_t i = 1; i < thread_count; i++)
+        threads.emplace_back(worker);
+    worker();
+
+    for (auto &thread : threads)
+        thread.join();
+}
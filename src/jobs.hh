@@ -0,0 +1,30 @@
+/**
+ * This file is part of SIGPacker. SIGPacker is free software:
+ * you can redistribute it and/or modify it under the terms of
+ * the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License,
+ * or (at your option) any later version.
+ *
+ * SIGPacker is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with SIGPacker.
+ * If not, see <https://www.gnu.org/licenses/>. 
+ *
+ * Copyright 2024, 2025 5IGI0 / Ethan L. C. Lorenzetti
+**/
+
+#ifndef JOBS_HH
+#define JOBS_HH
+
+#include <cstddef>
+#include <functional>
+
+/*  runs job(0) .. job(count-1) on `thread_count` threads (the caller is one of them).
+    jobs are picked in index order, so put the longest ones first. */
+void run_jobs(size_t count, size_t thread_count, std::function<void(size_t)> const &job);
+
+#endif
@@ -50,13 +50,11 @@ int main(int argc, char **argv) {
         return 1;
     }
 
-    std::srand(std::time(NULL));
-
     if (runtime.input_size > 2 && memcmp("MZ", runtime.input_content, 2) == 0) {
         handle_pe(runtime);
     } else {
         std::cerr << "unknown format" << std::endl;
     }
 
-    free(runtime.input_content);
+    unload_file(runtime.input_content, runtime.input_size);
 }
\ No newline at end of file
@@ -18,8 +18,12 @@
 **/
 
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 
 #include <getopt.h>
+#include <random>
+#include <thread>
 
 #include "structs.hh"
 
@@ -32,6 +36,11 @@ typedef enum {
     OPT_ID_POLYFORM_RE,
     OPT_ID_DONT_POLYFORM,
     OPT_ID_DONT_POLYFORM_RE,
+    OPT_ID_JOBS,
+    OPT_ID_SEED,
+    OPT_ID_VARIANTS,
+    OPT_ID_DEC_STUB,
+    OPT_ID_COALESCE_WEIGHT,
 } opt_id_t;
 
 const struct option longopt_list[] = {
@@ -43,10 +52,22 @@ const struct option longopt_list[] = {
     (struct option){.name = "polyform-regex",      .has_arg = 1, .val = OPT_ID_POLYFORM_RE},
     (struct option){.name = "dont-polyform",       .has_arg = 1, .val = OPT_ID_DONT_POLYFORM},
     (struct option){.name = "dont-polyform-regex", .has_arg = 1, .val = OPT_ID_DONT_POLYFORM_RE},
+    // performance-related
+    (struct option){.name = "jobs",                .has_arg = 1, .val = OPT_ID_JOBS},
+    (struct option){.name = "seed",                .has_arg = 1, .val = OPT_ID_SEED},
+    (struct option){.name = "variants",            .has_arg = 1, .val = OPT_ID_VARIANTS},
+    (struct option){.name = "dec-stub",            .has_arg = 1, .val = OPT_ID_DEC_STUB},
+    (struct option){.name = "coalesce-weight",     .has_arg = 1, .val = OPT_ID_COALESCE_WEIGHT},
     (struct option){0}};
 
 int parse_opts(int argc, char **argv, runtime_t *runtime) {
     int long_index = 0;
+
+    runtime->jobs = 1;
+    runtime->variants = 1;
+    runtime->coalesce_weight = 1;
+    std::random_device rd; // only used when there is no --seed
+    runtime->seed = ((uint64_t)rd() << 32) | rd();
     while (1) {
         int opt = getopt_long(argc, argv, "", longopt_list, NULL);
         if (opt == -1)
@@ -74,6 +95,57 @@ int parse_opts(int argc, char **argv, runtime_t *runtime) {
             case OPT_ID_DONT_POLYFORM_RE:
                 runtime->user_polylist.add_regex(optarg, false);
                 break;
+            case OPT_ID_JOBS: {
+                char *end;
+                long jobs = strtol(optarg, &end, 10);
+                if (*optarg == 0 || *end != 0 || jobs < 0) {
+                    printf("--jobs: expected a number of threads (0 = all cores)\n");
+                    return -1;
+                }
+                runtime->jobs = jobs ? jobs : std::thread::hardware_concurrency();
+                if (runtime->jobs == 0)
+                    runtime->jobs = 1;
+                break;
+            }
+            case OPT_ID_SEED: {
+                char *end;
+                runtime->seed = strtoull(optarg, &end, 0);
+                if (*optarg == 0 || *end != 0) {
+                    printf("--seed: expected a number\n");
+                    return -1;
+                }
+                break;
+            }
+            case OPT_ID_VARIANTS: {
+                char *end;
+                long variants = strtol(optarg, &end, 10);
+                if (*optarg == 0 || *end != 0 || variants < 1) {
+                    printf("--variants: expected a number of output files (>= 1)\n");
+                    return -1;
+                }
+                runtime->variants = variants;
+                break;
+            }
+            case OPT_ID_DEC_STUB:
+                if      (strcmp(optarg, "loop") == 0)     runtime->dec_stub = DEC_STUB_LOOP;
+                else if (strcmp(optarg, "unrolled") == 0) runtime->dec_stub = DEC_STUB_UNROLLED;
+                else if (strcmp(optarg, "simd") == 0)     runtime->dec_stub = DEC_STUB_SIMD;
+                else if (strcmp(optarg, "table") == 0)    runtime->dec_stub = DEC_STUB_TABLE;
+                else {
+                    printf("--dec-stub: expected loop, unrolled, simd or table\n");
+                    return -1;
+                }
+                break;
+            case OPT_ID_COALESCE_WEIGHT: {
+                // cost of decrypting extra bytes, 0 = coalesce every harmless gap, inf = never
+                char *end;
+                runtime->coalesce_weight = strtod(optarg, &end);
+                if (*optarg == 0 || *end != 0 || !(runtime->coalesce_weight >= 0)) {
+                    printf("--coalesce-weight: expected a non-negative number\n");
+                    return -1;
+                }
+                break;
+            }
         }
     }
 
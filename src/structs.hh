@@ -26,6 +26,14 @@
 
 #include "AllowList.hh"
 
+// shape of the runtime decryption loops (--dec-stub)
+enum {
+    DEC_STUB_LOOP,      // one dword per iteration
+    DEC_STUB_UNROLLED,  // 4 or 8 dwords per iteration
+    DEC_STUB_SIMD,      // 16 bytes per iteration (sse2)
+    DEC_STUB_TABLE,     // a single routine reading the ranges and keys from a table
+};
+
 typedef struct {
     char                *input_path;
     uint8_t             *input_content;
@@ -35,6 +43,11 @@ typedef struct {
     bool                only_explicit_polyform;
     bool                polyform_all;
     AllowList           user_polylist;
+    size_t              jobs;
+    uint64_t            seed;
+    size_t              variants;
+    int                 dec_stub;
+    double              coalesce_weight;
 } runtime_t;
 
 int parse_opts(int argc, char **argv, runtime_t *runtime);
@@ -22,30 +22,40 @@
 #include <stdint.h>
 #include <string.h>
 
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+/*  the input is mapped privately: pages are read from the page cache on demand
+    and only the ones we edit get copied, the file itself is never written. */
 uint8_t *load_file(char *path, size_t *outlen) {
-    FILE *fp = fopen(path, "rb");
+    int fd = open(path, O_RDONLY);
+    struct stat st;
 
-    if (fp == NULL)
+    if (fd < 0)
         return NULL;
 
-    int ret = fseek(fp, 0, SEEK_END);
-    long pos = ftell(fp);
-    ret |= fseek(fp, 0, SEEK_SET);
-
-    if (pos < 0 || ret < 0) {
-        fclose(fp);
+    if (fstat(fd, &st) < 0) {
+        close(fd);
         return NULL;
     }
 
-    uint8_t *content = malloc(pos);
-    if (content)
-        fread(content, 1, pos, fp);
+    // mmap() refuses empty mappings, map one byte instead (past EOF, touching it is a SIGBUS)
+    uint8_t *content = mmap(NULL, st.st_size ? st.st_size : 1, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    close(fd);
+
+    if (content == MAP_FAILED)
+        return NULL;
 
-    *outlen = pos;
-    fclose(fp);
+    *outlen = st.st_size;
     return content;
 }
 
+void unload_file(uint8_t *content, size_t len) {
+    munmap(content, len ? len : 1);
+}
+
 uint8_t *memdup(uint8_t *buff, size_t len) {
     uint8_t *ret = malloc(len);
     memcpy(ret, buff, len);
@@ -27,6 +27,7 @@
 extern "C" {
 #endif
 uint8_t *load_file(char *path, size_t *outlen);
+void     unload_file(uint8_t *content, size_t len);
 uint8_t *memdup(uint8_t *buff, size_t len);
 #ifdef __cplusplus
 }
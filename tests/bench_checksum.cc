@@ -0,0 +1,81 @@
+/**
+ * This file is part of SIGPacker. SIGPacker is free software:
+ * you can redistribute it and/or modify it under the terms of
+ * the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License,
+ * or (at your option) any later version.
+ *
+ * SIGPacker is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with SIGPacker.
+ * If not, see <https://www.gnu.org/licenses/>. 
+ *
+ * Copyright 2024, 2025 5IGI0 / Ethan L. C. Lorenzetti
+**/
+
+/*  checksum throughput over 100MB, before (the __builtin_uadd_overflow loop
+    pe_checksum_partial used to be) and after, for each kernel. */
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+#include "../src/formats/pe/pe.hh"
+
+#define BUFF_SIZE   (100 << 20)
+
+static uint32_t ref_checksum_partial(uint8_t const *data, size_t len, uint32_t sum) {
+    for (size_t i = 0; i < (len/4); i++) {
+        uint32_t dword;
+        memcpy(&dword, data + i*4, 4);
+        sum += __builtin_uadd_overflow(dword,sum,&sum);
+    }
+    return sum;
+}
+
+template<typename F>
+static void bench(char const *name, F sum) {
+    auto     begin = std::chrono::steady_clock::now();
+    size_t   count = 0;
+    uint32_t res;
+    double   elapsed;
+
+    do {
+        res = sum();
+        count++;
+        elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+    } while (elapsed < 1);
+
+    printf("%-28s %8.2f GB/s (%08x)\n", name, (double)BUFF_SIZE * count / elapsed / 1e9, res);
+}
+
+int main() {
+    static char const *kernels[] = {"scalar", "sse2", "avx2"};
+    std::vector<uint8_t> buff(BUFF_SIZE);
+    uint64_t state = 0x9E3779B97F4A7C15;
+
+    for (size_t i = 0; i < buff.size(); i += 8) {
+        state ^= state << 13;
+        state ^= state >> 7;
+        state ^= state << 17;
+        memcpy(&buff[i], &state, 8);
+    }
+
+    bench("before: uadd_overflow loop", [&]() { return ref_checksum_partial(buff.data(), BUFF_SIZE, 0); });
+    for (auto name : kernels) {
+        char label[64];
+
+        snprintf(label, sizeof(label), "after: %s", name);
+        if (!pe_checksum_use_kernel(name)) {
+            printf("%-28s unsupported\n", label);
+            continue;
+        }
+        bench(label, [&]() { return pe_checksum_partial(buff.data(), BUFF_SIZE, 0); });
+    }
+    return 0;
+}
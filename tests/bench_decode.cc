@@ -0,0 +1,91 @@
+/**
+ * This file is part of SIGPacker. SIGPacker is free software:
+ * you can redistribute it and/or modify it under the terms of
+ * the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License,
+ * or (at your option) any later version.
+ *
+ * SIGPacker is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with SIGPacker.
+ * If not, see <https://www.gnu.org/licenses/>. 
+ *
+ * Copyright 2024, 2025 5IGI0 / Ethan L. C. Lorenzetti
+**/
+
+/*  decode throughput, before (ZydisDisassembleIntel per instruction, what
+    the passes used to do) and after (shared decoders, minimal decoding).
+    usage: bench_decode [file] (raw bytes, default: this executable) */
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+#include "../src/arch/x86/polymorph.hh"
+
+static std::vector<uint8_t> read_file(char const *path) {
+    std::vector<uint8_t> content;
+    FILE *fp = fopen(path, "rb");
+    uint8_t buff[65536];
+    size_t  len;
+
+    if (fp == NULL) {
+        perror(path);
+        exit(1);
+    }
+    while ((len = fread(buff, 1, sizeof(buff), fp)) > 0)
+        content.insert(content.end(), buff, buff + len);
+    fclose(fp);
+    return content;
+}
+
+template<typename F>
+static void bench(char const *name, std::vector<uint8_t> &code, F decode) {
+    auto   begin = std::chrono::steady_clock::now();
+    size_t count = 0;
+    double elapsed;
+
+    do {
+        for (size_t off = 0; off < code.size();) {
+            size_t len = decode(code.data() + off, code.size() - off);
+            off += len ? len : 1;
+            count++;
+        }
+        elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+    } while (elapsed < 1);
+
+    printf("%-28s %12.0f instrs/s\n", name, count / elapsed);
+}
+
+int main(int argc, char **argv) {
+    std::vector<uint8_t> code = read_file(argc > 1 ? argv[1] : "/proc/self/exe");
+    int mode = ZYDIS_MACHINE_MODE_LONG_64;
+
+    bench("before: ZydisDisassembleIntel", code, [&](uint8_t *buff, size_t len) -> size_t {
+        ZydisDisassembledInstruction instr;
+        if (!ZYAN_SUCCESS(ZydisDisassembleIntel((ZydisMachineMode)mode, 0, buff, len, &instr)))
+            return 0;
+        return instr.info.length;
+    });
+
+    bench("after: x86_decode_buffer", code, [&](uint8_t *buff, size_t len) -> size_t {
+        x86_decoded_instr_t decoded;
+        if (!x86_decode_buffer(buff, len, mode, decoded))
+            return 0;
+        return decoded.info.length;
+    });
+
+    bench("after: x86_decode_minimal", code, [&](uint8_t *buff, size_t len) -> size_t {
+        ZydisDecodedInstruction info;
+        if (!x86_decode_minimal(buff, len, mode, info))
+            return 0;
+        return info.length;
+    });
+
+    return 0;
+}
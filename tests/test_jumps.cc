@@ -0,0 +1,222 @@
+/**
+ * This file is part of SIGPacker. SIGPacker is free software:
+ * you can redistribute it and/or modify it under the terms of
+ * the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License,
+ * or (at your option) any later version.
+ *
+ * SIGPacker is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with SIGPacker.
+ * If not, see <https://www.gnu.org/licenses/>. 
+ *
+ * Copyright 2024, 2025 5IGI0 / Ethan L. C. Lorenzetti
+**/
+
+/*  branch relaxation: random functions (fillers, nops, rel8 jumps, jcxz,
+    barriers) get instructions inserted until their nops run out. each
+    insertion is kept only if x86_jumps_fit says so, x86_fix_jumps must then
+    succeed and every jump must land on its destination. */
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iterator>
+#include <vector>
+
+#include "../src/arch/x86/polymorph.hh"
+#include "../src/arch/x86/jumps.hh"
+
+// the lists are built by hand, nothing is decoded
+bool x86_decode_buffer(uint8_t *, size_t, int, x86_decoded_instr_t &) {
+    abort();
+}
+
+static uint8_t pool[1 << 20];
+static size_t  pool_used = 0;
+
+static uint64_t xorshift(uint64_t &state) {
+    state ^= state << 13;
+    state ^= state >> 7;
+    state ^= state << 17;
+    return state;
+}
+
+static poly_instr_t make_instr(uint16_t mnemonic, uint8_t const *bytes, size_t length) {
+    poly_instr_t instr = {};
+
+    instr.addr = pool + pool_used;
+    memcpy(instr.addr, bytes, length);
+    pool_used += length;
+    instr.instruction.mnemonic     = mnemonic;
+    instr.instruction.length       = length;
+    instr.instruction.machine_mode = ZYDIS_MACHINE_MODE_LONG_64;
+    return instr;
+}
+
+static poly_instr_t make_filler(size_t length) {
+    static uint8_t const bytes[8] = {0x48, 0x89, 0xC0, 0x66, 0x66, 0x66, 0x66, 0x66};
+    return make_instr(ZYDIS_MNEMONIC_MOV, bytes, length);
+}
+
+static void gen_function(x86_instr_list_t &instrs, uint64_t &rng) {
+    std::vector<poly_instr_t> code;
+    std::vector<uint64_t>     addrs;
+    uint64_t addr = X86_DEFAULT_INSTR_LIST_VADDR;
+    int      id   = 0;
+
+    for (int i = 0; i < 400; i++) {
+        uint64_t     kind = xorshift(rng) % 100;
+        poly_instr_t instr;
+
+        if (kind < 35) {
+            instr = x86_nop_instr(ZYDIS_MACHINE_MODE_LONG_64);
+        } else if (kind < 80) {
+            instr = make_filler(2 + xorshift(rng) % 6);
+        } else if (kind < 95) {
+            uint8_t bytes[2] = {(uint8_t)(xorshift(rng) % 2 ? 0xEB : 0x74), 0};
+            instr = make_instr(bytes[0] == 0xEB ? ZYDIS_MNEMONIC_JMP : ZYDIS_MNEMONIC_JZ, bytes, 2);
+        } else if (kind < 97) {
+            uint8_t bytes[2] = {0xE3, 0}; // jrcxz, no rel32 form
+            instr = make_instr(ZYDIS_MNEMONIC_JRCXZ, bytes, 2);
+        } else {
+            instr = make_filler(5);
+            instr.is_position_dependent = true;
+        }
+
+        instr.id = ++id;
+        instr.instruction.runtime_address = addr;
+        addrs.push_back(addr);
+        addr += instr.instruction.length;
+        code.push_back(instr);
+    }
+
+    // rel8 targets that fit in the original layout
+    for (size_t i = 0; i < code.size(); i++) {
+        auto &jmp = code[i];
+        if (jmp.instruction.mnemonic == ZYDIS_MNEMONIC_MOV || jmp.instruction.mnemonic == ZYDIS_MNEMONIC_NOP)
+            continue;
+
+        size_t  dst = i + 1;
+        int64_t rel = 0;
+        for (int tries = 0; tries < 8; tries++) {
+            size_t  cand     = (i + code.size() - 60 + xorshift(rng) % 120) % code.size();
+            int64_t cand_rel = addrs[cand] - (addrs[i] + 2);
+            if (cand_rel >= -0x80 && cand_rel < 0x80) {
+                dst = cand;
+                rel = cand_rel;
+                break;
+            }
+        }
+        if (dst == code.size())
+            rel = 0; // the last instruction, no such destination
+        jmp.addr[1]                           = (uint8_t)rel;
+        jmp.instruction.imm                   = rel;
+        jmp.instruction.imm_size              = 8;
+        jmp.instruction.operand_count_visible = 1;
+        jmp.instruction.operand_types         = ZYDIS_OPERAND_TYPE_IMMEDIATE;
+    }
+
+    instrs.assign(code.begin(), code.end());
+}
+
+static int check_jumps(x86_instr_list_t &instrs) {
+    std::vector<uint64_t> by_id(1024, 0);
+    int failures = 0;
+
+    for (auto &instr : instrs) {
+        if (instr.id)
+            by_id[instr.id] = instr.instruction.runtime_address;
+    }
+
+    for (auto &jmp : instrs) {
+        if (!jmp.is_patchable_jump || jmp.jump_info.instr_id == 0)
+            continue;
+
+        size_t  length = jmp.instruction.length;
+        int64_t rel;
+        if (jmp.instruction.imm_size == 8) {
+            rel = (int8_t)jmp.addr[length-1];
+        } else {
+            int32_t rel32;
+            memcpy(&rel32, jmp.addr + length - 4, 4);
+            rel = rel32;
+            if (jmp.addr[length-5] != 0xE9 && (jmp.addr[length-6] != 0x0F || (jmp.addr[length-5] & 0xF0) != 0x80))
+                failures++;
+        }
+
+        if (jmp.instruction.runtime_address + length + rel != by_id[jmp.jump_info.instr_id]) {
+            fprintf(stderr, "jump at %lx lands on %lx, expected %lx\n",
+                (unsigned long)jmp.instruction.runtime_address,
+                (unsigned long)(jmp.instruction.runtime_address + length + rel),
+                (unsigned long)by_id[jmp.jump_info.instr_id]);
+            failures++;
+        }
+    }
+    return failures;
+}
+
+int main() {
+    uint64_t rng      = 0x9E3779B97F4A7C15;
+    int      failures = 0;
+    size_t   kept = 0, undone = 0;
+
+    for (int round = 0; round < 200; round++) {
+        x86_instr_list_t  instrs;
+        x86_space_index_t space;
+
+        pool_used = 0;
+        gen_function(instrs, rng);
+        x86_find_jump_destinations(instrs);
+        x86_build_space_index(instrs, space);
+
+        size_t size = 0;
+        for (auto &instr : instrs)
+            size += instr.instruction.length;
+
+        for (int i = 0; i < 300; i++) {
+            auto pos = instrs.begin();
+            std::advance(pos, xorshift(rng) % instrs.size());
+
+            int segment = pos->segment;
+            x86_instr_list_t saved;
+            int saved_space = x86_save_segment(instrs, space, segment, saved);
+
+            if (x86_insert_instr(make_filler(1 + xorshift(rng) % 4), instrs, space, pos) == instrs.end())
+                continue;
+            if (x86_jumps_fit(instrs, space)) {
+                kept++;
+            } else {
+                x86_restore_segment(instrs, space, segment, saved, saved_space);
+                undone++;
+            }
+        }
+
+        if (x86_fix_jumps(instrs, space) < 0) {
+            fprintf(stderr, "round %d: x86_fix_jumps failed\n", round);
+            failures++;
+            continue;
+        }
+
+        size_t new_size = 0;
+        for (auto &instr : instrs)
+            new_size += instr.instruction.length;
+        if (new_size != size) {
+            fprintf(stderr, "round %d: size %zu, expected %zu\n", round, new_size, size);
+            failures++;
+        }
+        failures += check_jumps(instrs);
+        x86_free_instr_list(instrs);
+    }
+
+    if (failures) {
+        fprintf(stderr, "%d failures\n", failures);
+        return 1;
+    }
+    printf("jumps: ok (%zu insertions kept, %zu undone)\n", kept, undone);
+    return 0;
+}
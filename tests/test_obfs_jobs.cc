@@ -0,0 +1,112 @@
+/**
+ * This file is part of SIGPacker. SIGPacker is free software:
+ * you can redistribute it and/or modify it under the terms of
+ * the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License,
+ * or (at your option) any later version.
+ *
+ * SIGPacker is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with SIGPacker.
+ * If not, see <https://www.gnu.org/licenses/>. 
+ *
+ * Copyright 2024, 2025 5IGI0 / Ethan L. C. Lorenzetti
+**/
+
+/*  pe_obfs_encrypt_all gives the same bytes on one thread and on many:
+    disjoint ranges of all sizes (one of several chunks, chunk edges, tiny ones),
+    and nothing outside of them is touched. */
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+#include "../src/formats/pe/data_obfs/data_obfs.hh"
+
+static uint64_t xorshift(uint64_t &state) {
+    state ^= state << 13;
+    state ^= state >> 7;
+    state ^= state << 17;
+    return state;
+}
+
+static std::vector<uint8_t> encrypt(std::vector<uint8_t> const &plain, std::vector<data_obfs_ctx_t> const &contexts, size_t jobs) {
+    std::vector<uint8_t>   buff(plain);
+    std::vector<uint8_t *> data;
+
+    for (auto &ctx : contexts)
+        data.push_back(buff.data() + ctx.vaddr);
+    pe_obfs_encrypt_all(contexts, data, jobs);
+    return buff;
+}
+
+int main() {
+    static size_t const lengths[] = {
+        3*OBFS_CHUNK_SIZE + 12, OBFS_CHUNK_SIZE, OBFS_CHUNK_SIZE + 4, OBFS_CHUNK_SIZE - 4,
+        4, 8, 60, 4096, 100000, 2*OBFS_CHUNK_SIZE, 12, 777*4,
+    };
+    std::vector<data_obfs_ctx_t> contexts;
+    uint64_t rng    = 0x9E3779B97F4A7C15;
+    size_t   offset = 16;
+
+    // vaddr is the offset of the range in the buffer here
+    for (auto len : lengths) {
+        data_obfs_ctx_t ctx = {};
+
+        ctx.vaddr    = offset;
+        ctx.len      = len;
+        ctx.op_count = 1 + xorshift(rng) % 5;
+        for (size_t j = 0; j < ctx.op_count; j++) {
+            ctx.ops[j].op_type = xorshift(rng) % OBFS_OP_TYPE_COUNT;
+            ctx.ops[j].key     = xorshift(rng);
+        }
+        contexts.push_back(ctx);
+        offset += len + 4 * (1 + xorshift(rng) % 64);
+    }
+
+    std::vector<uint8_t> plain(offset + 16);
+    for (auto &byte : plain)
+        byte = xorshift(rng);
+
+    std::vector<uint8_t> single = encrypt(plain, contexts, 1);
+    int failures = 0;
+
+    // gaps between the ranges are left as they were
+    size_t prev_end = 0;
+    for (auto &ctx : contexts) {
+        if (memcmp(&single[prev_end], &plain[prev_end], ctx.vaddr - prev_end) != 0) {
+            fprintf(stderr, "gap before range at %lu was modified\n", (unsigned long)ctx.vaddr);
+            failures++;
+        }
+        if (memcmp(&single[ctx.vaddr], &plain[ctx.vaddr], ctx.len) == 0) {
+            fprintf(stderr, "range at %lu was not encrypted\n", (unsigned long)ctx.vaddr);
+            failures++;
+        }
+        prev_end = ctx.vaddr + ctx.len;
+    }
+    if (memcmp(&single[prev_end], &plain[prev_end], plain.size() - prev_end) != 0) {
+        fprintf(stderr, "the end of the buffer was modified\n");
+        failures++;
+    }
+
+    size_t const jobs[] = {2, 3, 8, std::thread::hardware_concurrency() + 1};
+    for (auto count : jobs) {
+        if (encrypt(plain, contexts, count) != single) {
+            fprintf(stderr, "jobs=%zu differs from jobs=1\n", count);
+            failures++;
+        }
+    }
+
+    if (failures) {
+        fprintf(stderr, "%d failures\n", failures);
+        return 1;
+    }
+    printf("obfs jobs: ok\n");
+    return 0;
+}
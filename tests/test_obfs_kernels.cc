@@ -0,0 +1,144 @@
+/**
+ * This file is part of SIGPacker. SIGPacker is free software:
+ * you can redistribute it and/or modify it under the terms of
+ * the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License,
+ * or (at your option) any later version.
+ *
+ * SIGPacker is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with SIGPacker.
+ * If not, see <https://www.gnu.org/licenses/>. 
+ *
+ * Copyright 2024, 2025 5IGI0 / Ethan L. C. Lorenzetti
+**/
+
+/*  the encryption kernels against the inverse of the decryption stub, done
+    dword by dword: random op chains, lengths that are not a multiple of the
+    vector width and unaligned buffers, for each kernel the cpu can run. */
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#include "../src/formats/pe/data_obfs/data_obfs.hh"
+
+static int failures = 0;
+
+static uint64_t xorshift(uint64_t &state) {
+    state ^= state << 13;
+    state ^= state >> 7;
+    state ^= state << 17;
+    return state;
+}
+
+static uint32_t rotl(uint32_t value, uint32_t count) {
+    count &= 31;
+    return count ? (value << count) | (value >> (32 - count)) : value;
+}
+
+static uint32_t rotr(uint32_t value, uint32_t count) {
+    return rotl(value, 32 - (count & 31));
+}
+
+// what the stubs run at startup
+static uint32_t ref_decrypt(data_obfs_ctx_t const &ctx, uint32_t tmp) {
+    for (size_t j = 0; j < ctx.op_count; j++) {
+        uint32_t key = ctx.ops[j].key;
+        switch (ctx.ops[j].op_type) {
+            case OBFS_OP_TYPE_ADD: tmp += key;            break;
+            case OBFS_OP_TYPE_SUB: tmp -= key;            break;
+            case OBFS_OP_TYPE_XOR: tmp ^= key;            break;
+            case OBFS_OP_TYPE_ROL: tmp = rotl(tmp, key);  break;
+            case OBFS_OP_TYPE_ROR: tmp = rotr(tmp, key);  break;
+        }
+    }
+    return tmp;
+}
+
+// and its inverse, op by op in reverse order
+static uint32_t ref_encrypt(data_obfs_ctx_t const &ctx, uint32_t tmp) {
+    for (ssize_t j = ctx.op_count-1; j >= 0; j--) {
+        uint32_t key = ctx.ops[j].key;
+        switch (ctx.ops[j].op_type) {
+            case OBFS_OP_TYPE_ADD: tmp -= key;            break;
+            case OBFS_OP_TYPE_SUB: tmp += key;            break;
+            case OBFS_OP_TYPE_XOR: tmp ^= key;            break;
+            case OBFS_OP_TYPE_ROL: tmp = rotr(tmp, key);  break;
+            case OBFS_OP_TYPE_ROR: tmp = rotl(tmp, key);  break;
+        }
+    }
+    return tmp;
+}
+
+static data_obfs_ctx_t random_ctx(uint64_t &rng) {
+    data_obfs_ctx_t ctx = {};
+
+    ctx.op_count = 1 + xorshift(rng) % 5;
+    for (size_t j = 0; j < ctx.op_count; j++) {
+        ctx.ops[j].op_type = xorshift(rng) % OBFS_OP_TYPE_COUNT;
+        ctx.ops[j].key     = xorshift(rng);
+        if (xorshift(rng) % 4 == 0) // the small rotations and the 0/32 edges
+            ctx.ops[j].key = xorshift(rng) % 33;
+    }
+    return ctx;
+}
+
+static void check_block(char const *name, data_obfs_ctx_t const &ctx, uint8_t *data, size_t count, uint64_t &rng) {
+    std::vector<uint32_t> plain(count);
+
+    for (size_t i = 0; i < count; i++) {
+        plain[i] = xorshift(rng);
+        memcpy(data + i*4, &plain[i], 4);
+    }
+
+    pe_obfs_encrypt_block(ctx, data, count*4);
+
+    for (size_t i = 0; i < count; i++) {
+        uint32_t got;
+        memcpy(&got, data + i*4, 4);
+        if (got != ref_encrypt(ctx, plain[i]) || ref_decrypt(ctx, got) != plain[i]) {
+            if (failures++ < 10)
+                fprintf(stderr, "%s: %zu dwords, dword %zu: got %08x, expected %08x\n",
+                    name, count, i, got, ref_encrypt(ctx, plain[i]));
+            return;
+        }
+    }
+}
+
+int main() {
+    static char const *kernels[] = {"scalar", "sse2", "avx2"};
+    std::vector<uint8_t> buff(4 * 4096 + 4);
+    uint64_t rng = 0x9E3779B97F4A7C15;
+
+    for (auto name : kernels) {
+        int before = failures;
+
+        if (!pe_obfs_use_kernel(name)) {
+            printf("%s: unsupported, skipped\n", name);
+            continue;
+        }
+
+        // every length around the vector widths (4 vectors of 4 or 8 dwords per iteration)
+        for (size_t count = 0; count <= 100; count++)
+            for (size_t misalign = 0; misalign < 4; misalign++)
+                check_block(name, random_ctx(rng), buff.data() + misalign, count, rng);
+
+        for (int i = 0; i < 2000; i++) {
+            size_t count = xorshift(rng) % 4096;
+            check_block(name, random_ctx(rng), buff.data() + xorshift(rng) % 4, count, rng);
+        }
+        printf("%s: %s\n", name, failures == before ? "ok" : "FAILED");
+    }
+
+    if (failures) {
+        fprintf(stderr, "%d failures\n", failures);
+        return 1;
+    }
+    return 0;
+}
@@ -17,11 +17,28 @@
  * Copyright 2024, 2025 5IGI0 / Ethan L. C. Lorenzetti
 **/
 
-#include "../../third/zydis/Zydis.h"
+/*  the register tables against the switches they replaced (registers.c before
+    the tables), over every ZydisRegister value.
+    expected differences: r8d-r15d now have a 32 bits form, and the 8/16 bits
+    sizes are new. */
 
-#include "registers.h"
+#include <cstdio>
+#include <cstdlib>
 
-int x86_get_unsized_register(int reg) {
+#include "../src/third/zydis/Zydis.h"
+#include "../src/arch/x86/registers.h"
+
+static int failures = 0;
+
+#define CHECK_EQ(what, arg, got, expected) do {                                     \
+        int _got = (got), _expected = (expected);                                   \
+        if (_got != _expected) {                                                    \
+            fprintf(stderr, "%s(%d): got %d, expected %d\n", what, arg, _got, _expected); \
+            failures++;                                                             \
+        }                                                                           \
+    } while (0)
+
+static int old_get_unsized_register(int reg) {
     switch (reg) {
         case ZYDIS_REGISTER_NONE:
             return REG_NONE;
@@ -32,46 +49,46 @@ int x86_get_unsized_register(int reg) {
         case ZYDIS_REGISTER_EAX:
         case ZYDIS_REGISTER_RAX:
             return REG_RAX;
-        
+
         case  ZYDIS_REGISTER_BL:
         case  ZYDIS_REGISTER_BH:
         case  ZYDIS_REGISTER_BX:
         case ZYDIS_REGISTER_EBX:
         case ZYDIS_REGISTER_RBX:
             return REG_RBX;
-        
+
         case  ZYDIS_REGISTER_CL:
         case  ZYDIS_REGISTER_CH:
         case  ZYDIS_REGISTER_CX:
         case ZYDIS_REGISTER_ECX:
         case ZYDIS_REGISTER_RCX:
             return REG_RCX;
-        
+
         case  ZYDIS_REGISTER_DL:
         case  ZYDIS_REGISTER_DH:
         case  ZYDIS_REGISTER_DX:
         case ZYDIS_REGISTER_EDX:
         case ZYDIS_REGISTER_RDX:
             return REG_RDX;
-        
+
         case  ZYDIS_REGISTER_SPL:
         case  ZYDIS_REGISTER_SP:
         case ZYDIS_REGISTER_ESP:
         case ZYDIS_REGISTER_RSP:
             return REG_RSP;
-        
+
         case  ZYDIS_REGISTER_BPL:
         case  ZYDIS_REGISTER_BP:
         case ZYDIS_REGISTER_EBP:
         case ZYDIS_REGISTER_RBP:
             return REG_RBP;
-        
+
         case  ZYDIS_REGISTER_DIL:
         case  ZYDIS_REGISTER_DI:
         case ZYDIS_REGISTER_EDI:
         case ZYDIS_REGISTER_RDI:
             return REG_RDI;
-        
+
         case  ZYDIS_REGISTER_SIL:
         case  ZYDIS_REGISTER_SI:
         case ZYDIS_REGISTER_ESI:
@@ -130,7 +147,7 @@ int x86_get_unsized_register(int reg) {
         case ZYDIS_REGISTER_EIP:
         case ZYDIS_REGISTER_IP:
                 return REG_RIP;
-        
+
         case ZYDIS_REGISTER_FLAGS:
         case ZYDIS_REGISTER_EFLAGS:
         case ZYDIS_REGISTER_RFLAGS:
@@ -141,7 +158,7 @@ int x86_get_unsized_register(int reg) {
     }
 }
 
-int x86_get_64_register(int reg) {
+static int old_get_64_register(int reg) {
     switch (reg) {
         case REG_RAX:   return ZYDIS_REGISTER_RAX;
         case REG_RBX:   return ZYDIS_REGISTER_RBX;
@@ -164,7 +181,7 @@ int x86_get_64_register(int reg) {
     }
 }
 
-int x86_get_32_register(int reg) {
+static int old_get_32_register(int reg) {
     switch (reg) {
         case REG_RAX:   return ZYDIS_REGISTER_EAX;
         case REG_RBX:   return ZYDIS_REGISTER_EBX;
@@ -179,10 +196,78 @@ int x86_get_32_register(int reg) {
     }
 }
 
-int x86_get_register_by_size(int reg, int size) {
+static int old_get_register_by_size(int reg, int size) {
     switch (size) {
-        case 8: return x86_get_64_register(reg);
-        case 4: return x86_get_32_register(reg);
+        case 8: return old_get_64_register(reg);
+        case 4: return old_get_32_register(reg);
         default: return -1;
     }
-}
\ No newline at end of file
+}
+// not in the old switches
+static int const sized_8_16[][3] = {
+    {REG_RAX, ZYDIS_REGISTER_AL,   ZYDIS_REGISTER_AX},
+    {REG_RBX, ZYDIS_REGISTER_BL,   ZYDIS_REGISTER_BX},
+    {REG_RCX, ZYDIS_REGISTER_CL,   ZYDIS_REGISTER_CX},
+    {REG_RDX, ZYDIS_REGISTER_DL,   ZYDIS_REGISTER_DX},
+    {REG_RSI, ZYDIS_REGISTER_SIL,  ZYDIS_REGISTER_SI},
+    {REG_RDI, ZYDIS_REGISTER_DIL,  ZYDIS_REGISTER_DI},
+    {REG_RBP, ZYDIS_REGISTER_BPL,  ZYDIS_REGISTER_BP},
+    {REG_RSP, ZYDIS_REGISTER_SPL,  ZYDIS_REGISTER_SP},
+    {REG_R8,  ZYDIS_REGISTER_R8B,  ZYDIS_REGISTER_R8W},
+    {REG_R9,  ZYDIS_REGISTER_R9B,  ZYDIS_REGISTER_R9W},
+    {REG_R10, ZYDIS_REGISTER_R10B, ZYDIS_REGISTER_R10W},
+    {REG_R11, ZYDIS_REGISTER_R11B, ZYDIS_REGISTER_R11W},
+    {REG_R12, ZYDIS_REGISTER_R12B, ZYDIS_REGISTER_R12W},
+    {REG_R13, ZYDIS_REGISTER_R13B, ZYDIS_REGISTER_R13W},
+    {REG_R14, ZYDIS_REGISTER_R14B, ZYDIS_REGISTER_R14W},
+    {REG_R15, ZYDIS_REGISTER_R15B, ZYDIS_REGISTER_R15W},
+    {REG_RIP, -1,                  ZYDIS_REGISTER_IP},
+};
+
+static int expected_32(int reg) {
+    if (reg >= REG_R8 && reg <= REG_R15)
+        return ZYDIS_REGISTER_R8D + (reg - REG_R8);
+    return old_get_32_register(reg);
+}
+
+static int expected_by_size(int reg, int size) {
+    switch (size) {
+        case 1:
+        case 2:
+            for (auto &row : sized_8_16)
+                if (row[0] == reg)
+                    return row[size];
+            return -1;
+        case 4: return expected_32(reg);
+        default: return old_get_register_by_size(reg, size);
+    }
+}
+
+int main() {
+    for (int reg = -1; reg <= ZYDIS_REGISTER_MAX_VALUE + 1; reg++)
+        CHECK_EQ("x86_get_unsized_register", reg, x86_get_unsized_register(reg), old_get_unsized_register(reg));
+
+    for (int reg = -1; reg <= REG_COUNT; reg++) {
+        CHECK_EQ("x86_get_64_register", reg, x86_get_64_register(reg), old_get_64_register(reg));
+        CHECK_EQ("x86_get_32_register", reg, x86_get_32_register(reg), expected_32(reg));
+
+        for (int size = 0; size <= 16; size++)
+            CHECK_EQ("x86_get_register_by_size", reg * 100 + size, x86_get_register_by_size(reg, size), expected_by_size(reg, size));
+    }
+
+    // every sized register goes back to its unsized one
+    for (int reg = REG_NONE + 1; reg < REG_COUNT; reg++) {
+        for (int size = 1; size <= 8; size *= 2) {
+            int sized = x86_get_register_by_size(reg, size);
+            if (sized >= 0)
+                CHECK_EQ("round trip", reg * 100 + size, x86_get_unsized_register(sized), reg);
+        }
+    }
+
+    if (failures) {
+        fprintf(stderr, "%d failures\n", failures);
+        return 1;
+    }
+    printf("registers: ok\n");
+    return 0;
+}